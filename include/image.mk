@@ -41,6 +41,17 @@ KDIR=$(KERNEL_BUILD_DIR)
 KDIR_TMP=$(KDIR)/tmp
 DTS_DIR:=$(LINUX_DIR)/arch/$(LINUX_KARCH)/boot/dts
 
+# Expensive Build/* commands whose result only depends on the input image,
+# their arguments and the files named in their recipe
+IMAGE_STEP_CACHE_CMDS ?= fit gzip libdeflate-gzip lzma lzma-no-dict
+# Environment read by these commands that changes their result
+IMAGE_STEP_CACHE_ENV ?= SOURCE_DATE_EPOCH
+IMAGE_STEP_CACHE_DIR := $(if $(call qstrip,$(CONFIG_IMAGE_STEP_CACHE_DIR)),$(call qstrip,$(CONFIG_IMAGE_STEP_CACHE_DIR)),$(BUILD_DIR)/image-step-cache)
+IMAGE_STEP_CACHE_STATS = $(KDIR_TMP)/.step-cache-stats
+ifneq ($(CONFIG_IMAGE_STEP_CACHE),)
+  IMAGE_STEP_CACHE_RUN := $(shell date +%s.%N)
+endif
+
 ifeq ($(EXTRA_IMAGE_NAME),)
 EXTRA_IMAGE_NAME:=$(call qstrip,$(CONFIG_EXTRA_IMAGE_NAME))
 endif
@@ -157,8 +168,28 @@ endef
 ##
 define build_cmd
 $(if $(Build/$(word 1,$(1))),,$(error Missing Build/$(word 1,$(1))))
-$(call Build/$(word 1,$(1)),$(wordlist 2,$(words $(1)),$(1)))
+$(if $(call step_cacheable,$(1)),$(call step_cache_cmd,$(1)),$(call Build/$(word 1,$(1)),$(wordlist 2,$(words $(1)),$(1))))
+
+endef
+
+step_cacheable = $(and $(CONFIG_IMAGE_STEP_CACHE),$(filter $(word 1,$(1)),$(IMAGE_STEP_CACHE_CMDS)))
 
+##@
+# @brief Run build function through the image step cache.
+#
+# The expanded recipe is written to a step file next to the target and
+# executed by image-step-cache.sh, which reuses a previous result if the
+# input image, the recipe and all files it references are unchanged.
+#
+# @param 1: Function to call. Function name is prepended with `Build/`.
+# @param 2...: Function arguments.
+##
+define step_cache_cmd
+$(eval step_cache_idx += x)
+$(file >$@.step$(words $(step_cache_idx)),$(call Build/$(word 1,$(1)),$(wordlist 2,$(words $(1)),$(1))))
+IMAGE_STEP_CACHE_ENV="$(IMAGE_STEP_CACHE_ENV)" \
+$(SCRIPT_DIR)/image-step-cache.sh run $(IMAGE_STEP_CACHE_DIR) $(IMAGE_STEP_CACHE_STATS) \
+	$(IMAGE_STEP_CACHE_RUN) $(word 1,$(1)) $@ $@.step$(words $(step_cache_idx))
 endef
 
 ##@
@@ -996,6 +1027,7 @@ define BuildImage
     compile-dtb:
     image_prepare: compile compile-dtb
 		mkdir -p $(BIN_DIR) $(KDIR)/tmp
+		rm -f $(IMAGE_STEP_CACHE_STATS)
 		rm -rf $(BUILD_DIR)/json_info_files
 		$(call Image/Prepare)
 
@@ -1021,5 +1053,7 @@ define BuildImage
 
   install: install-images
 	$(call Image/Manifest)
+	$(if $(CONFIG_IMAGE_STEP_CACHE),$(SCRIPT_DIR)/image-step-cache.sh stats $(IMAGE_STEP_CACHE_STATS))
+	$(if $(CONFIG_IMAGE_STEP_CACHE),$(SCRIPT_DIR)/image-step-cache.sh prune $(IMAGE_STEP_CACHE_DIR) $(CONFIG_IMAGE_STEP_CACHE_SIZE))
 
 endef
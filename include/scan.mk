@@ -43,23 +43,38 @@ else
   endef
 endif
 
+SCAN_NOW:=perl -MTime::HiRes=time -e 'printf "%d\n", time * 1000'
+TIMING_LOG:=$(TMP_DIR)/info/.timing-$(SCAN_TARGET)
+
+# Skip the dump if the content of the Makefile and its dependencies is
+# unchanged, even if their mtime is newer than the info file.
 define PackageDir
   $(TMP_DIR)/.$(SCAN_TARGET): $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1)
   $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1): $(SCAN_DIR)/$(2)/Makefile $(foreach DEP,$(DEPS_$(SCAN_DIR)/$(2)/Makefile) $(SCAN_DEPS),$(wildcard $(if $(filter /%,$(DEP)),$(DEP),$(SCAN_DIR)/$(2)/$(DEP))))
-	{ \
-		$$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
-		echo Source-Makefile: $(SCAN_DIR)/$(2)/Makefile; \
-		$(if $(3),echo Override: $(3),true); \
-		$(if $(findstring c,$(OPENWRT_VERBOSE)),$(MAKE),$(NO_TRACE_MAKE) --no-print-dir) -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) \
-			$(if $(findstring c,$(OPENWRT_VERBOSE)),,2>/dev/null) || { \
-			mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
-			$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
-			$$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
-			rm -f $$@; \
-		}; \
-		echo; \
-	} > $$@.tmp
-	mv $$@.tmp $$@
+	hash="$$$$($(SCRIPT_DIR)/scan-hash.sh $(SCAN_DIR)/$(2) "$(SCAN_MAKEOPTS) $(call feedname,$(2)) $(3)" $$^)"; \
+	if [ -s $$@ ] && [ "$$$$hash" = "$$$$(cat $$@.hash 2>/dev/null)" ]; then \
+		touch $$@; \
+		echo "- $(SCAN_DIR)/$(2)" >> $(TIMING_LOG); \
+	else \
+		start="$$$$($(SCAN_NOW))"; \
+		echo "$$$$hash" > $$@.hash.tmp; \
+		{ \
+			$$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
+			echo Source-Makefile: $(SCAN_DIR)/$(2)/Makefile; \
+			$(if $(3),echo Override: $(3),true); \
+			$(if $(findstring c,$(OPENWRT_VERBOSE)),$(MAKE),$(NO_TRACE_MAKE) --no-print-dir) -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) \
+				$(if $(findstring c,$(OPENWRT_VERBOSE)),,2>/dev/null) || { \
+				mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
+				$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
+				$$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
+				rm -f $$@ $$@.hash $$@.hash.tmp; \
+			}; \
+			echo; \
+		} > $$@.tmp; \
+		mv $$@.tmp $$@; \
+		[ ! -f $$@.hash.tmp ] || mv $$@.hash.tmp $$@.hash; \
+		echo "$$$$(($$$$($(SCAN_NOW)) - start)) $(SCAN_DIR)/$(2)" >> $(TIMING_LOG); \
+	fi
 endef
 
 $(OVERRIDELIST):
@@ -116,7 +131,16 @@ $(TMP_DIR)/.$(SCAN_TARGET): $(TARGET_STAMP)
 	-cat $(FILELIST) | awk '{gsub(/\//, "_", $$0);print "$(TMP_DIR)/info/.$(SCAN_TARGET)-" $$0}' | xargs cat > $@ 2>/dev/null
 	$(call progress,Collecting $(SCAN_NAME) info: done)
 	echo
+	-[ ! -f $(TIMING_LOG) ] || sort -rn $(TIMING_LOG) | awk ' \
+		BEGIN { dumped = 0; skipped = 0 } \
+		$$1 == "-" { skipped++; next } \
+		{ if (dumped < 5) slow[dumped] = $$0; dumped++; total += $$1 } \
+		END { \
+			if (!dumped) exit; \
+			printf "Collecting $(SCAN_NAME) info: %d dumped (%.1fs total), %d unchanged\n", dumped, total / 1000, skipped; \
+			for (i = 0; i < dumped && i < 5; i++) { split(slow[i], f, " "); printf "  %6d ms  %s\n", f[1], f[2] } \
+		}'
+	rm -f $(TIMING_LOG)
 
 FORCE:
 .PHONY: FORCE
-.NOTPARALLEL:
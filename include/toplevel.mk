@@ -63,6 +63,11 @@ endif
 SCAN_COOKIE?=$(shell echo $$$$)
 export SCAN_COOKIE
 
+# The scan shares the jobserver of the calling make, unless SCAN_JOBS is
+# set to run it with a fixed number of jobs. MAKEFLAGS is still cleared,
+# only the jobserver handle is passed on.
+SCAN_MAKE=$(_SINGLE)$(NO_TRACE_MAKE) $(if $(SCAN_JOBS),-j$(SCAN_JOBS),$(or $(filter --jobserver%,$(MAKEFLAGS)),-j1))
+
 SUBMAKE:=umask 022; $(SUBMAKE)
 
 ULIMIT_FIX=_limit=`ulimit -n`; [ "$$_limit" = "unlimited" -o "$$_limit" -ge 1024 ] || ulimit -n 1024;
@@ -79,8 +84,8 @@ prepare-tmpinfo: FORCE
 	@+$(MAKE) -r -s $(STAGING_DIR_HOST)/.prereq-build $(PREP_MK)
 	mkdir -p tmp/info feeds
 	[ -e $(TOPDIR)/feeds/base ] || ln -sf ../package $(TOPDIR)/feeds/base
-	$(_SINGLE)$(NO_TRACE_MAKE) -j1 -r -s -f include/scan.mk SCAN_TARGET="packageinfo" SCAN_DIR="package" SCAN_NAME="package" SCAN_DEPTH=5 SCAN_EXTRA=""
-	$(_SINGLE)$(NO_TRACE_MAKE) -j1 -r -s -f include/scan.mk SCAN_TARGET="targetinfo" SCAN_DIR="target/linux" SCAN_NAME="target" SCAN_DEPTH=3 SCAN_EXTRA="" SCAN_MAKEOPTS="TARGET_BUILD=1"
+	+$(SCAN_MAKE) -r -s -f include/scan.mk SCAN_TARGET="packageinfo" SCAN_DIR="package" SCAN_NAME="package" SCAN_DEPTH=5 SCAN_EXTRA=""
+	+$(SCAN_MAKE) -r -s -f include/scan.mk SCAN_TARGET="targetinfo" SCAN_DIR="target/linux" SCAN_NAME="target" SCAN_DEPTH=3 SCAN_EXTRA="" SCAN_MAKEOPTS="TARGET_BUILD=1"
 	for type in package target; do \
 		f=tmp/.$${type}info; t=tmp/.config-$${type}.in; \
 		[ "$$t" -nt "$$f" ] || ./scripts/$${type}-metadata.pl $(_ignore) config "$$f" > "$$t" || { rm -f "$$t"; echo "Failed to build $$t"; false; break; }; \
@@ -100,6 +105,7 @@ prepare-tmpinfo: FORCE
 ifeq ($(RECURSIVE_DEP_IS_ERROR),1)
   KCONF_FLAGS=--fatalrecursive
 endif
+export KCONFIG_PARSE_CACHE=$(TOPDIR)/tmp/.config-parse-cache
 ifneq ($(DISTRO_PKG_CONFIG),)
 scripts/config/%onf: export PATH:=$(dir $(DISTRO_PKG_CONFIG)):$(PATH)
 endif
@@ -245,12 +251,12 @@ endif
 
 # update all feeds, re-create index files, install symlinks
 package/symlinks:
-	./scripts/feeds update -a
+	+./scripts/feeds update -a
 	./scripts/feeds install -a
 
 # re-create index files, install symlinks
 package/symlinks-install:
-	./scripts/feeds update -i
+	+./scripts/feeds update -i
 	./scripts/feeds install -a
 
 # remove all symlinks, don't touch ./feeds
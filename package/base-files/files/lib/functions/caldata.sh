@@ -3,12 +3,21 @@
 . /lib/functions.sh
 . /lib/functions/system.sh
 
+# native helper from the mtd package, replaces the dd and hexdump calls
+# below and reads, patches and writes a blob in one run
+CALDATA_BIN=/sbin/caldata
+
 caldata_dd() {
 	local source=$1
 	local target=$2
 	local count=$(($3))
 	local offset=$(($4))
 
+	if [ -x "$CALDATA_BIN" ]; then
+		$CALDATA_BIN extract $source $offset $count write $target
+		return $?
+	fi
+
 	dd if=$source of=$target iflag=skip_bytes,fullblock bs=$count skip=$offset count=1 2>/dev/null
 	return $?
 }
@@ -70,6 +79,13 @@ caldata_extract_reverse() {
 	local caldata
 
 	mtd=$(find_mtd_chardev "$part")
+
+	if [ -x "$CALDATA_BIN" ]; then
+		$CALDATA_BIN extract $mtd $offset $count reverse \
+			write /lib/firmware/$FIRMWARE
+		return
+	fi
+
 	reversed=$(hexdump -v -s $offset -n $count -e '1/1 "%02x "' $mtd)
 
 	for byte in $reversed; do
@@ -135,6 +151,13 @@ caldata_patch_data() {
 
 	[ -n "$target" ] || target=/lib/firmware/$FIRMWARE
 
+	if [ -x "$CALDATA_BIN" ]; then
+		$CALDATA_BIN load $target patch $data_offset $data $chksum_offset \
+			write $target || \
+			caldata_die "failed to patch eeprom file"
+		return
+	fi
+
 	fw_data=$(hexdump -v -n $data_count -s $data_offset -e '1/1 "%02x"' $target)
 
 	if [ "$data" != "$fw_data" ]; then
@@ -196,13 +219,29 @@ ath10k_remove_regdomain() {
 
 ath11k_remove_regdomain() {
 	local target=$1
+	local offsets="0x450 0x458 0x500 0x5a8"
 	local regdomain
 	local regdomain_data
+	local patches
+
+	[ -n "$target" ] || target=/lib/firmware/$FIRMWARE
 
 	regdomain=$(hexdump -v -n 2 -s 0x34 -e '1/1 "%02x"' $target)
+
+	if [ -x "$CALDATA_BIN" ]; then
+		for offset in $offsets; do
+			patches="$patches patch-if $offset $regdomain 0000 0xa"
+		done
+
+		$CALDATA_BIN load $target patch 0x34 0000 0xa $patches \
+			write $target || \
+			caldata_die "failed to patch eeprom file"
+		return
+	fi
+
 	caldata_patch_data "0000" 0x34 0xa "$target"
-	
-	for offset in 0x450 0x458 0x500 0x5a8; do
+
+	for offset in $offsets; do
 		regdomain_data=$(hexdump -v -n 2 -s $offset -e '1/1 "%02x"' $target)
 
 		if [ "$regdomain" == "$regdomain_data" ]; then
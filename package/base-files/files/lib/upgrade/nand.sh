@@ -307,26 +307,59 @@ nand_upgrade_fit() {
 	$cmd < "$fit_file" | ubiupdatevol /dev/$fit_ubivol -s "$fit_length" -
 }
 
+# Read board dir, member sizes and rootfs magic from the TAR file headers in a
+# single pass. Also checks the archive for corruption.
+nand_tarflash_info() {
+	local tar_file="$1"
+	local cmd="$2"
+
+	if [ "$cmd" = cat ]; then
+		tarflash info -f "$tar_file"
+	else
+		$cmd < "$tar_file" | tarflash info
+	fi
+}
+
 # Write images in the TAR file to MTD partitions and/or UBI volumes as required
 nand_upgrade_tar() {
 	local tar_file="$1"
 	local cmd="${2:-cat}"
 	local jffs2_markers="${CI_JFFS2_CLEAN_MARKERS:-0}"
+	local tarflash="$(command -v tarflash)"
 
-	# WARNING: This fails if tar contains more than one 'sysupgrade-*' directory.
-	local board_dir="$($cmd < "$tar_file" | tar tf - | grep -m 1 '^sysupgrade-.*/$')"
-	board_dir="${board_dir%/}"
+	local board_dir kernel_length rootfs_length rootfs_magic
+	if [ "$tarflash" ]; then
+		local info
+		if ! info="$(nand_tarflash_info "$tar_file" "$cmd")"; then
+			echo "corrupted sysupgrade tar file"
+			return 1
+		fi
+		eval "$info"
+	else
+		# WARNING: This fails if tar contains more than one 'sysupgrade-*' directory.
+		board_dir="$($cmd < "$tar_file" | tar tf - | grep -m 1 '^sysupgrade-.*/$')"
+		board_dir="${board_dir%/}"
+		[ "$CI_KERNPART" != "none" ] && \
+			kernel_length=$( ($cmd < "$tar_file" | tar xOf - "$board_dir/kernel" | wc -c) 2> /dev/null)
+		rootfs_length=$( ($cmd < "$tar_file" | tar xOf - "$board_dir/root" | wc -c) 2> /dev/null)
+	fi
 
-	local kernel_mtd kernel_length
+	local kernel_mtd
 	if [ "$CI_KERNPART" != "none" ]; then
 		kernel_mtd="$(find_mtd_index "$CI_KERNPART")"
-		kernel_length=$( ($cmd < "$tar_file" | tar xOf - "$board_dir/kernel" | wc -c) 2> /dev/null)
 		[ "$kernel_length" = 0 ] && kernel_length=
+	else
+		kernel_length=
 	fi
-	local rootfs_length=$( ($cmd < "$tar_file" | tar xOf - "$board_dir/root" | wc -c) 2> /dev/null)
 	[ "$rootfs_length" = 0 ] && rootfs_length=
 	local rootfs_type
-	[ "$rootfs_length" ] && rootfs_type="$(identify_tar "$tar_file" "$cmd" "$board_dir/root")"
+	if [ "$rootfs_length" ]; then
+		if [ "$tarflash" ]; then
+			rootfs_type="$(identify_magic_long "$rootfs_magic")"
+		else
+			rootfs_type="$(identify_tar "$tar_file" "$cmd" "$board_dir/root")"
+		fi
+	fi
 
 	# If CI_SKIP_KERNEL_MTD is set, ignore any potential kernel MTD partition that was found.
 	# This is needed if there's an MTD partition with the same name as the kernel's UBI volume.
@@ -348,28 +381,46 @@ nand_upgrade_tar() {
 	local has_env=0
 	nand_upgrade_prepare_ubi "$rootfs_length" "$rootfs_type" "$ubi_kernel_length" "$has_env" || return 1
 
+	local root_ubivol kern_ubivol kernel_write
 	if [ "$rootfs_length" ]; then
 		local ubidev="$( nand_find_ubi "${CI_ROOT_UBIPART:-$CI_UBIPART}" )"
-		local root_ubivol="$( nand_find_volume $ubidev "$CI_ROOTPART" )"
-		$cmd < "$tar_file" | tar xOf - "$board_dir/root" | \
-			ubiupdatevol /dev/$root_ubivol -s "$rootfs_length" -
+		root_ubivol="$( nand_find_volume $ubidev "$CI_ROOTPART" )"
 	fi
 	if [ "$kernel_length" ]; then
 		if [ "$kernel_mtd" ]; then
 			if [ "$jffs2_markers" = 1 ]; then
-				flash_erase -j "/dev/mtd${kernel_mtd}" 0 0
-				$cmd < "$tar_file" | tar xOf - "$board_dir/kernel" | \
-					nandwrite "/dev/mtd${kernel_mtd}" -
+				kernel_write="flash_erase -j /dev/mtd${kernel_mtd} 0 0; nandwrite /dev/mtd${kernel_mtd} -"
 			else
-				$cmd < "$tar_file" | tar xOf - "$board_dir/kernel" | \
-					mtd write - "$CI_KERNPART"
+				kernel_write="mtd write - $CI_KERNPART"
 			fi
 		else
 			local ubidev="$( nand_find_ubi "${CI_KERN_UBIPART:-$CI_UBIPART}" )"
-			local kern_ubivol="$( nand_find_volume $ubidev "$CI_KERNPART" )"
-			$cmd < "$tar_file" | tar xOf - "$board_dir/kernel" | \
-				ubiupdatevol /dev/$kern_ubivol -s "$kernel_length" -
+			kern_ubivol="$( nand_find_volume $ubidev "$CI_KERNPART" )"
+			kernel_write="ubiupdatevol /dev/$kern_ubivol -s $kernel_length -"
+		fi
+	fi
+
+	if [ "$tarflash" ]; then
+		# stream both members to flash in a single pass over the archive
+		set --
+		[ "$rootfs_length" ] && set -- "$@" -r "/dev/$root_ubivol"
+		if [ "$kern_ubivol" ]; then
+			set -- "$@" -k "/dev/$kern_ubivol"
+		elif [ "$kernel_write" ]; then
+			set -- "$@" -k "$kernel_write"
 		fi
+		[ $# -gt 0 ] || return 0
+		$cmd < "$tar_file" | tarflash write -d "$board_dir" "$@" || return 1
+		return 0
+	fi
+
+	if [ "$rootfs_length" ]; then
+		$cmd < "$tar_file" | tar xOf - "$board_dir/root" | \
+			ubiupdatevol /dev/$root_ubivol -s "$rootfs_length" -
+	fi
+	if [ "$kernel_write" ]; then
+		$cmd < "$tar_file" | tar xOf - "$board_dir/kernel" | \
+			sh -c "$kernel_write"
 	fi
 
 	return 0
@@ -423,7 +474,9 @@ nand_do_flash_file() {
 			nand_upgrade_ubifs "$file" "$cmd"
 			;;
 		*)
-			nand_verify_tar_file "$file" "$cmd" || return 1
+			# tarflash checks the archive while reading its headers
+			command -v tarflash > /dev/null || \
+				nand_verify_tar_file "$file" "$cmd" || return 1
 			nand_upgrade_tar "$file" "$cmd"
 			;;
 	esac
@@ -0,0 +1,1128 @@
+/*
+ * minstrel-sim: replay synthetic loss traces through mac80211 rate control
+ *
+ * Copyright (C) 2026 OpenWrt.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * The tool creates two mac80211_hwsim radios and registers itself as their
+ * wireless medium, in the same way wmediumd does. A setup command brings up
+ * a link between the radios, then UDP traffic is sent from the first radio
+ * to the second. For every data frame the transmit status is computed from
+ * a trace of per-rate delivery probabilities, so the rate control algorithm
+ * of the running kernel (minstrel_ht) sees a repeatable channel.
+ *
+ * Trace file format, one event per line:
+ *
+ *	<time in ms> <rate pattern> <delivery probability>
+ *
+ * Rates are named "<Mbps>M" for legacy rates, "ht<mcs>" for HT and
+ * "vht<nss>.<mcs>" for VHT. Patterns use fnmatch(3) syntax, the last
+ * matching event wins:
+ *
+ *	0	*	0.95
+ *	0	ht1[2-5]	0.1
+ *	5000	ht1[2-5]	0.9
+ *
+ * For each phase between event times, the tool reports how long it took
+ * until the rate chosen as first in the retry chain achieved a given share
+ * of the best possible expected throughput. If the function profiler of
+ * ftrace is available, the time spent in the minstrel_ht status and rate
+ * lookup callbacks is reported as well.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+
+/* from drivers/net/wireless/virtual/mac80211_hwsim.h */
+enum {
+	HWSIM_CMD_UNSPEC,
+	HWSIM_CMD_REGISTER,
+	HWSIM_CMD_FRAME,
+	HWSIM_CMD_TX_INFO_FRAME,
+	HWSIM_CMD_NEW_RADIO,
+	HWSIM_CMD_DEL_RADIO,
+	HWSIM_CMD_GET_RADIO,
+};
+
+enum {
+	HWSIM_ATTR_UNSPEC,
+	HWSIM_ATTR_ADDR_RECEIVER,
+	HWSIM_ATTR_ADDR_TRANSMITTER,
+	HWSIM_ATTR_FRAME,
+	HWSIM_ATTR_FLAGS,
+	HWSIM_ATTR_RX_RATE,
+	HWSIM_ATTR_SIGNAL,
+	HWSIM_ATTR_TX_INFO,
+	HWSIM_ATTR_COOKIE,
+	HWSIM_ATTR_CHANNELS,
+	HWSIM_ATTR_RADIO_ID,
+	HWSIM_ATTR_REG_HINT_ALPHA2,
+	HWSIM_ATTR_REG_CUSTOM_REG,
+	HWSIM_ATTR_REG_STRICT_REG,
+	HWSIM_ATTR_SUPPORT_P2P_DEVICE,
+	HWSIM_ATTR_USE_CHANCTX,
+	HWSIM_ATTR_DESTROY_RADIO_ON_CLOSE,
+	HWSIM_ATTR_RADIO_NAME,
+	HWSIM_ATTR_NO_VIF,
+	HWSIM_ATTR_FREQ,
+	HWSIM_ATTR_PAD,
+	HWSIM_ATTR_TX_INFO_FLAGS,
+	HWSIM_ATTR_PERM_ADDR,
+	__HWSIM_ATTR_MAX,
+};
+#define HWSIM_ATTR_MAX (__HWSIM_ATTR_MAX - 1)
+
+#define HWSIM_TX_CTL_REQ_TX_STATUS	(1 << 0)
+#define HWSIM_TX_CTL_NO_ACK		(1 << 1)
+#define HWSIM_TX_STAT_ACK		(1 << 2)
+
+#define HWSIM_TX_RC_MCS			(1 << 3)
+#define HWSIM_TX_RC_40_MHZ_WIDTH	(1 << 5)
+#define HWSIM_TX_RC_SHORT_GI		(1 << 7)
+#define HWSIM_TX_RC_VHT_MCS		(1 << 8)
+#define HWSIM_TX_RC_80_MHZ_WIDTH	(1 << 9)
+#define HWSIM_TX_RC_160_MHZ_WIDTH	(1 << 10)
+
+#define TX_MAX_RATES	4
+
+struct hwsim_tx_rate {
+	int8_t idx;
+	uint8_t count;
+} __attribute__((packed));
+
+struct hwsim_tx_rate_flag {
+	int8_t idx;
+	uint16_t flags;
+} __attribute__((packed));
+
+#define N_RADIOS	2
+#define SIGNAL_DBM	-50
+#define BIN_MS		100
+#define MAX_RATES	128
+/* frames must fit into a single netlink receive buffer */
+#define MAX_PAYLOAD	2000
+
+#define LOCAL_ADDR	"10.253.0.1"
+#define PEER_ADDR	"10.253.0.2"
+#define DEFAULT_SETUP	"/usr/libexec/minstrel-sim-setup"
+#define DEFAULT_CHAN	"2412 HT20"
+
+struct event {
+	unsigned int time;
+	char pattern[32];
+	double prob;
+};
+
+struct rate {
+	char name[16];
+	double mbps;
+	double prob;
+	int phase;
+};
+
+struct bin {
+	unsigned int start;
+	int phase;
+	double tput_sum;
+	double opt;
+	unsigned long frames;
+	unsigned long acked_bytes;
+};
+
+static const double legacy_2g[] = { 1, 2, 5.5, 11, 6, 9, 12, 18, 24, 36, 48, 54 };
+static const double legacy_5g[] = { 6, 9, 12, 18, 24, 36, 48, 54 };
+static const double ht_mbps[] = { 6.5, 13, 19.5, 26, 39, 52, 58.5, 65 };
+static const double vht_mbps[] = { 6.5, 13, 19.5, 26, 39, 52, 58.5, 65, 78, 86.7 };
+
+static struct nl_sock *sk;
+static int family;
+
+static uint8_t radio_addr[N_RADIOS][6];
+static char radio_name[N_RADIOS][16];
+
+static struct event *events;
+static int n_events;
+static unsigned int *phase_start;
+static int n_phases;
+
+static struct rate rates[MAX_RATES];
+static int n_rates;
+
+static struct bin *bins;
+static int n_bins;
+static struct bin cur_bin;
+
+static bool running;
+static struct timespec t_start;
+static int cur_phase;
+
+static unsigned long n_updates, n_attempts, n_acked, n_other;
+static unsigned int payload_len = 1400;
+static unsigned long n_sent, n_send_err;
+
+static double threshold = 0.9;
+static unsigned int window_ms = 1000;
+
+static volatile sig_atomic_t stop;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <trace>\n"
+		"Options:\n"
+		"  -c <chan>     frequency and width passed to the setup command\n"
+		"                (default \"%s\")\n"
+		"  -d <ms>       duration (default: last trace event + 10000)\n"
+		"  -o <file>     write results as JSON\n"
+		"  -p <pps>      packets per second to send (default 2000)\n"
+		"  -s <bytes>    UDP payload size (default 1400)\n"
+		"  -S <seed>     random seed (default 1)\n"
+		"  -t <ratio>    share of the optimal throughput counted as\n"
+		"                converged (default 0.9)\n"
+		"  -w <ms>       time the rate must stay converged (default 1000)\n"
+		"  -x <cmd>      setup command (default %s)\n",
+		prog, DEFAULT_CHAN, DEFAULT_SETUP);
+	exit(1);
+}
+
+static unsigned int now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec - t_start.tv_sec) * 1000 +
+	       (ts.tv_nsec - t_start.tv_nsec) / 1000000;
+}
+
+static int load_trace(const char *file)
+{
+	char line[256];
+	FILE *f;
+	int lineno = 0;
+
+	f = fopen(file, "r");
+	if (!f) {
+		perror(file);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		struct event ev = {};
+		char *hash = strchr(line, '#');
+
+		lineno++;
+		if (hash)
+			*hash = 0;
+
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+
+		if (sscanf(line, "%u %31s %lf", &ev.time, ev.pattern, &ev.prob) != 3 ||
+		    ev.prob < 0 || ev.prob > 1) {
+			fprintf(stderr, "%s:%d: invalid event\n", file, lineno);
+			fclose(f);
+			return -1;
+		}
+
+		if (n_events && ev.time < events[n_events - 1].time) {
+			fprintf(stderr, "%s:%d: events must be sorted by time\n",
+				file, lineno);
+			fclose(f);
+			return -1;
+		}
+
+		events = realloc(events, (n_events + 1) * sizeof(*events));
+		events[n_events++] = ev;
+
+		if (!n_phases || phase_start[n_phases - 1] != ev.time) {
+			phase_start = realloc(phase_start, (n_phases + 1) * sizeof(*phase_start));
+			phase_start[n_phases++] = ev.time;
+		}
+	}
+	fclose(f);
+
+	if (!n_events) {
+		fprintf(stderr, "%s: no events\n", file);
+		return -1;
+	}
+
+	/* everything before the first event is loss free */
+	if (phase_start[0]) {
+		phase_start = realloc(phase_start, (n_phases + 1) * sizeof(*phase_start));
+		memmove(phase_start + 1, phase_start, n_phases * sizeof(*phase_start));
+		phase_start[0] = 0;
+		n_phases++;
+	}
+
+	return 0;
+}
+
+static double rate_prob(const char *name, unsigned int time)
+{
+	double prob = 1;
+	int i;
+
+	for (i = 0; i < n_events && events[i].time <= time; i++)
+		if (!fnmatch(events[i].pattern, name, 0))
+			prob = events[i].prob;
+
+	return prob;
+}
+
+static struct rate *rate_get(const struct hwsim_tx_rate_flag *rf, uint32_t freq)
+{
+	uint16_t flags = rf->flags;
+	struct rate *r;
+	char name[16];
+	double mbps;
+	int i;
+
+	if (flags & HWSIM_TX_RC_VHT_MCS) {
+		int mcs = rf->idx & 0xf, nss = (rf->idx >> 4) + 1;
+
+		if (mcs >= (int)(sizeof(vht_mbps) / sizeof(vht_mbps[0])))
+			return NULL;
+
+		snprintf(name, sizeof(name), "vht%d.%d", nss, mcs);
+		mbps = vht_mbps[mcs] * nss;
+		if (flags & HWSIM_TX_RC_160_MHZ_WIDTH)
+			mbps *= 58.5 / 6.5;
+		else if (flags & HWSIM_TX_RC_80_MHZ_WIDTH)
+			mbps *= 29.25 / 6.5;
+		else if (flags & HWSIM_TX_RC_40_MHZ_WIDTH)
+			mbps *= 13.5 / 6.5;
+	} else if (flags & HWSIM_TX_RC_MCS) {
+		snprintf(name, sizeof(name), "ht%d", rf->idx);
+		mbps = ht_mbps[rf->idx % 8] * (rf->idx / 8 + 1);
+		if (flags & HWSIM_TX_RC_40_MHZ_WIDTH)
+			mbps *= 13.5 / 6.5;
+	} else {
+		const double *tbl = freq < 3000 ? legacy_2g : legacy_5g;
+		int n = freq < 3000 ? 12 : 8;
+
+		if (rf->idx >= n)
+			return NULL;
+
+		mbps = tbl[rf->idx];
+		snprintf(name, sizeof(name), "%gM", mbps);
+	}
+
+	if (flags & HWSIM_TX_RC_SHORT_GI)
+		mbps = mbps * 10 / 9;
+
+	for (i = 0; i < n_rates; i++) {
+		r = &rates[i];
+		if (!strcmp(r->name, name) && r->mbps == mbps)
+			goto out;
+	}
+
+	if (n_rates == MAX_RATES)
+		return NULL;
+
+	r = &rates[n_rates++];
+	strcpy(r->name, name);
+	r->mbps = mbps;
+	r->phase = -1;
+
+out:
+	if (r->phase != cur_phase) {
+		r->prob = rate_prob(r->name, phase_start[cur_phase]);
+		r->phase = cur_phase;
+	}
+
+	return r;
+}
+
+static double optimal_tput(struct rate **best)
+{
+	double opt = 0;
+	int i;
+
+	*best = NULL;
+	for (i = 0; i < n_rates; i++) {
+		struct rate *r = &rates[i];
+
+		if (r->phase != cur_phase) {
+			r->prob = rate_prob(r->name, phase_start[cur_phase]);
+			r->phase = cur_phase;
+		}
+
+		if (r->mbps * r->prob > opt) {
+			opt = r->mbps * r->prob;
+			*best = r;
+		}
+	}
+
+	return opt;
+}
+
+static void bin_close(void)
+{
+	struct rate *best;
+
+	if (cur_bin.frames) {
+		cur_bin.opt = optimal_tput(&best);
+		bins = realloc(bins, (n_bins + 1) * sizeof(*bins));
+		bins[n_bins++] = cur_bin;
+	}
+
+	memset(&cur_bin, 0, sizeof(cur_bin));
+}
+
+static void update_time(void)
+{
+	unsigned int now = now_ms();
+	int phase = cur_phase;
+
+	while (phase + 1 < n_phases && phase_start[phase + 1] <= now)
+		phase++;
+
+	if (phase != cur_phase) {
+		bin_close();
+		cur_phase = phase;
+		cur_bin.start = phase_start[phase];
+	} else if (now >= cur_bin.start + BIN_MS) {
+		bin_close();
+		cur_bin.start = now - (now - phase_start[phase]) % BIN_MS;
+	}
+
+	cur_bin.phase = cur_phase;
+}
+
+static int radio_idx(const uint8_t *addr)
+{
+	int i;
+
+	for (i = 0; i < N_RADIOS; i++)
+		if (!memcmp(addr, radio_addr[i], 6))
+			return i;
+
+	return -1;
+}
+
+static int no_seq_check(struct nl_msg *msg, void *arg)
+{
+	return NL_OK;
+}
+
+static int ack_handler(struct nl_msg *msg, void *arg)
+{
+	int *ret = arg;
+
+	*ret = 0;
+
+	return NL_STOP;
+}
+
+static int error_handler(struct sockaddr_nl *nla, struct nlmsgerr *err, void *arg)
+{
+	int *ret = arg;
+
+	*ret = err->error;
+
+	return NL_STOP;
+}
+
+static int send_and_wait(struct nl_msg *msg)
+{
+	struct nl_cb *cb;
+	int ret = INT_MIN;
+
+	if (!msg)
+		return -ENOMEM;
+
+	cb = nl_cb_alloc(NL_CB_DEFAULT);
+	if (!cb) {
+		nlmsg_free(msg);
+		return -ENOMEM;
+	}
+
+	nl_cb_err(cb, NL_CB_CUSTOM, error_handler, &ret);
+	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, ack_handler, &ret);
+
+	if (nl_send_auto_complete(sk, msg) < 0)
+		ret = -EIO;
+
+	while (ret == INT_MIN)
+		if (nl_recvmsgs(sk, cb) < 0)
+			break;
+
+	nl_cb_put(cb);
+	nlmsg_free(msg);
+
+	return ret == INT_MIN ? -EIO : ret;
+}
+
+static struct nl_msg *hwsim_msg(int cmd)
+{
+	struct nl_msg *msg = nlmsg_alloc();
+
+	if (msg)
+		genlmsg_put(msg, 0, 0, family, 0, 0, cmd, 1);
+
+	return msg;
+}
+
+static int hwsim_new_radio(int i)
+{
+	struct nl_msg *msg = hwsim_msg(HWSIM_CMD_NEW_RADIO);
+
+	if (!msg)
+		return -ENOMEM;
+
+	radio_addr[i][0] = 0x02;
+	radio_addr[i][1] = 'm';
+	radio_addr[i][2] = 's';
+	radio_addr[i][3] = (getpid() >> 8) & 0xff;
+	radio_addr[i][4] = getpid() & 0xff;
+	radio_addr[i][5] = i;
+	snprintf(radio_name[i], sizeof(radio_name[i]), "msim%d", i);
+
+	nla_put_string(msg, HWSIM_ATTR_RADIO_NAME, radio_name[i]);
+	nla_put(msg, HWSIM_ATTR_PERM_ADDR, 6, radio_addr[i]);
+	nla_put_flag(msg, HWSIM_ATTR_DESTROY_RADIO_ON_CLOSE);
+	nla_put_flag(msg, HWSIM_ATTR_NO_VIF);
+
+	/* a positive reply is the id of the new radio */
+	return send_and_wait(msg) < 0 ? -1 : 0;
+}
+
+static void send_tx_info(const uint8_t *addr, uint32_t flags, uint64_t cookie,
+			 const struct hwsim_tx_rate *tx_rates)
+{
+	struct nl_msg *msg = hwsim_msg(HWSIM_CMD_TX_INFO_FRAME);
+
+	if (!msg)
+		return;
+
+	nla_put(msg, HWSIM_ATTR_ADDR_TRANSMITTER, 6, addr);
+	nla_put_u32(msg, HWSIM_ATTR_FLAGS, flags);
+	nla_put_u64(msg, HWSIM_ATTR_COOKIE, cookie);
+	nla_put_u32(msg, HWSIM_ATTR_SIGNAL, SIGNAL_DBM);
+	nla_put(msg, HWSIM_ATTR_TX_INFO, TX_MAX_RATES * sizeof(*tx_rates), tx_rates);
+	nl_send_auto_complete(sk, msg);
+	nlmsg_free(msg);
+}
+
+static void send_frame(int rx, const void *data, int len, uint32_t freq)
+{
+	struct nl_msg *msg = nlmsg_alloc_size(len + 256);
+
+	if (!msg)
+		return;
+
+	genlmsg_put(msg, 0, 0, family, 0, 0, HWSIM_CMD_FRAME, 1);
+	nla_put(msg, HWSIM_ATTR_ADDR_RECEIVER, 6, radio_addr[rx]);
+	nla_put(msg, HWSIM_ATTR_FRAME, len, data);
+	/* legacy rate index, must be valid for the band */
+	nla_put_u32(msg, HWSIM_ATTR_RX_RATE, 0);
+	nla_put_u32(msg, HWSIM_ATTR_SIGNAL, SIGNAL_DBM);
+	if (freq)
+		nla_put_u32(msg, HWSIM_ATTR_FREQ, freq);
+	nl_send_auto_complete(sk, msg);
+	nlmsg_free(msg);
+}
+
+static bool simulate_tx(struct hwsim_tx_rate *tx_rates,
+			const struct hwsim_tx_rate_flag *tx_flags, uint32_t freq,
+			struct rate **primary)
+{
+	int i, j;
+
+	*primary = NULL;
+	for (i = 0; i < TX_MAX_RATES; i++) {
+		struct hwsim_tx_rate_flag rf = { tx_rates[i].idx, 0 };
+		struct rate *r;
+
+		if (tx_rates[i].idx < 0 || !tx_rates[i].count)
+			break;
+
+		if (tx_flags)
+			rf.flags = tx_flags[i].flags;
+
+		r = rate_get(&rf, freq);
+		if (!i)
+			*primary = r;
+
+		for (j = 1; j <= tx_rates[i].count; j++) {
+			n_attempts++;
+			if (r && drand48() >= r->prob)
+				continue;
+
+			tx_rates[i].count = j;
+			for (i++; i < TX_MAX_RATES; i++) {
+				tx_rates[i].idx = -1;
+				tx_rates[i].count = 0;
+			}
+			return true;
+		}
+	}
+
+	for (; i < TX_MAX_RATES; i++) {
+		tx_rates[i].idx = -1;
+		tx_rates[i].count = 0;
+	}
+
+	return false;
+}
+
+static int frame_handler(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr *tb[HWSIM_ATTR_MAX + 1];
+	struct hwsim_tx_rate tx_rates[TX_MAX_RATES];
+	const struct hwsim_tx_rate_flag *tx_flags = NULL;
+	const uint8_t *tx_addr, *frame;
+	uint32_t flags, freq = 0;
+	uint64_t cookie;
+	int len, tx, i;
+	bool data, group, acked;
+
+	if (gnlh->cmd != HWSIM_CMD_FRAME)
+		return NL_SKIP;
+
+	nla_parse(tb, HWSIM_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
+		  genlmsg_attrlen(gnlh, 0), NULL);
+
+	if (!tb[HWSIM_ATTR_ADDR_TRANSMITTER] || !tb[HWSIM_ATTR_FRAME] ||
+	    !tb[HWSIM_ATTR_FLAGS] || !tb[HWSIM_ATTR_COOKIE] ||
+	    !tb[HWSIM_ATTR_TX_INFO] ||
+	    nla_len(tb[HWSIM_ATTR_TX_INFO]) < (int)sizeof(tx_rates))
+		return NL_SKIP;
+
+	tx_addr = nla_data(tb[HWSIM_ATTR_ADDR_TRANSMITTER]);
+	frame = nla_data(tb[HWSIM_ATTR_FRAME]);
+	len = nla_len(tb[HWSIM_ATTR_FRAME]);
+	flags = nla_get_u32(tb[HWSIM_ATTR_FLAGS]);
+	cookie = nla_get_u64(tb[HWSIM_ATTR_COOKIE]);
+	memcpy(tx_rates, nla_data(tb[HWSIM_ATTR_TX_INFO]), sizeof(tx_rates));
+	if (tb[HWSIM_ATTR_FREQ])
+		freq = nla_get_u32(tb[HWSIM_ATTR_FREQ]);
+	if (tb[HWSIM_ATTR_TX_INFO_FLAGS] &&
+	    nla_len(tb[HWSIM_ATTR_TX_INFO_FLAGS]) >= (int)(TX_MAX_RATES * sizeof(*tx_flags)))
+		tx_flags = nla_data(tb[HWSIM_ATTR_TX_INFO_FLAGS]);
+
+	if (len < 10)
+		return NL_SKIP;
+
+	tx = radio_idx(tx_addr);
+	data = (frame[0] & 0x0c) == 0x08;
+	group = frame[4] & 1;
+
+	if (tx == 0 && running && data && !group && !(flags & HWSIM_TX_CTL_NO_ACK)) {
+		struct rate *primary;
+
+		update_time();
+		acked = simulate_tx(tx_rates, tx_flags, freq, &primary);
+
+		n_updates++;
+		cur_bin.frames++;
+		if (primary)
+			cur_bin.tput_sum += primary->mbps * primary->prob;
+		if (acked) {
+			n_acked++;
+			cur_bin.acked_bytes += payload_len;
+		}
+	} else {
+		/* management, group addressed frames and other radios are
+		 * delivered without loss */
+		acked = true;
+		if (tx_rates[0].count > 1)
+			tx_rates[0].count = 1;
+		for (i = 1; i < TX_MAX_RATES; i++) {
+			tx_rates[i].idx = -1;
+			tx_rates[i].count = 0;
+		}
+		n_other++;
+	}
+
+	send_tx_info(tx_addr, flags | (acked && !group ? HWSIM_TX_STAT_ACK : 0),
+		     cookie, tx_rates);
+
+	if (tx < 0 || !acked)
+		return NL_SKIP;
+
+	for (i = 0; i < N_RADIOS; i++)
+		if (i != tx)
+			send_frame(i, frame, len, freq);
+
+	return NL_SKIP;
+}
+
+static int traffic_open(void)
+{
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(9),
+	};
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	inet_pton(AF_INET, PEER_ADDR, &sin.sin_addr);
+	if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, radio_name[0],
+		       strlen(radio_name[0])) < 0 ||
+	    connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("traffic socket");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+#define SETUP_MAX_ARGS	16
+
+static pid_t run_setup(const char *cmd, const char *chan)
+{
+	char *argv[SETUP_MAX_ARGS + 1] = {
+		"sh", "-c", "exec $0 \"$@\"", (char *)cmd, radio_name[0],
+		radio_name[1], LOCAL_ADDR, PEER_ADDR,
+	};
+	char *words, *word;
+	int argc = 8;
+	pid_t pid = fork();
+
+	if (pid)
+		return pid;
+
+	/* iw expects the frequency and the width as separate arguments */
+	words = strdup(chan);
+	for (word = strtok(words, " \t"); word && argc < SETUP_MAX_ARGS;
+	     word = strtok(NULL, " \t"))
+		argv[argc++] = word;
+	argv[argc] = NULL;
+
+	execv("/bin/sh", argv);
+	perror("exec");
+	_exit(127);
+}
+
+struct profile {
+	const char *func;
+	unsigned long hits;
+	double usecs;
+};
+
+static struct profile profile[] = {
+	{ "minstrel_ht_tx_status", 0, 0 },
+	{ "minstrel_ht_get_rate", 0, 0 },
+};
+
+static const char *tracing_dir(void)
+{
+	if (!access("/sys/kernel/tracing/function_profile_enabled", W_OK))
+		return "/sys/kernel/tracing";
+	if (!access("/sys/kernel/debug/tracing/function_profile_enabled", W_OK))
+		return "/sys/kernel/debug/tracing";
+
+	return NULL;
+}
+
+static int tracing_write(const char *file, const char *val)
+{
+	char path[128];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", tracing_dir(), file);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -1;
+
+	ret = write(fd, val, strlen(val));
+	close(fd);
+
+	return ret < 0 ? -1 : 0;
+}
+
+static bool profile_start(void)
+{
+	char filter[128];
+
+	if (!tracing_dir())
+		return false;
+
+	snprintf(filter, sizeof(filter), "%s %s\n", profile[0].func, profile[1].func);
+	if (tracing_write("set_ftrace_filter", filter) ||
+	    tracing_write("function_profile_enabled", "0") ||
+	    tracing_write("function_profile_enabled", "1")) {
+		fprintf(stderr, "Function profiler unavailable, not measuring CPU time\n");
+		tracing_write("set_ftrace_filter", "");
+		return false;
+	}
+
+	return true;
+}
+
+static void profile_stop(void)
+{
+	char path[128], line[256], func[64];
+	unsigned int i, cpu;
+
+	tracing_write("function_profile_enabled", "0");
+
+	for (cpu = 0; ; cpu++) {
+		FILE *f;
+
+		snprintf(path, sizeof(path), "%s/trace_stat/function%u",
+			 tracing_dir(), cpu);
+		f = fopen(path, "r");
+		if (!f)
+			break;
+
+		while (fgets(line, sizeof(line), f)) {
+			unsigned long hits;
+			double usecs = 0;
+
+			if (sscanf(line, "%63s %lu %lf", func, &hits, &usecs) < 2)
+				continue;
+
+			for (i = 0; i < sizeof(profile) / sizeof(profile[0]); i++) {
+				if (strcmp(func, profile[i].func) != 0)
+					continue;
+
+				profile[i].hits += hits;
+				profile[i].usecs += usecs;
+			}
+		}
+		fclose(f);
+	}
+
+	tracing_write("set_ftrace_filter", "");
+}
+
+struct phase_result {
+	unsigned int start, end;
+	int converged;
+	double opt, score;
+	double goodput;
+	const struct rate *best;
+};
+
+static void phase_result(int phase, unsigned int end, struct phase_result *res)
+{
+	unsigned int window = (window_ms + BIN_MS - 1) / BIN_MS;
+	unsigned int run = 0, run_start = 0;
+	unsigned long frames = 0, bytes = 0;
+	double tput = 0;
+	struct rate *best;
+	int i;
+
+	memset(res, 0, sizeof(*res));
+	res->start = phase_start[phase];
+	res->end = phase + 1 < n_phases ? phase_start[phase + 1] : end;
+	res->converged = -1;
+
+	cur_phase = phase;
+	res->opt = optimal_tput(&best);
+	res->best = best;
+
+	for (i = 0; i < n_bins; i++) {
+		struct bin *b = &bins[i];
+
+		if (b->phase != phase)
+			continue;
+
+		frames += b->frames;
+		bytes += b->acked_bytes;
+		tput += b->tput_sum;
+
+		if (res->converged >= 0)
+			continue;
+
+		if (b->opt && b->tput_sum / b->frames < threshold * b->opt) {
+			run = 0;
+			continue;
+		}
+
+		if (!run++)
+			run_start = b->start;
+		if (run >= window)
+			res->converged = run_start - res->start;
+	}
+
+	if (frames && res->opt)
+		res->score = tput / frames / res->opt;
+	if (res->end > res->start)
+		res->goodput = bytes * 8.0 / 1000 / (res->end - res->start);
+}
+
+static void report(FILE *json, unsigned int duration, bool profiled)
+{
+	unsigned int i;
+	int p;
+
+	printf("status updates: %lu (%.0f/s), %.2f attempts per update, %.1f%% acked\n",
+	       n_updates, n_updates * 1000.0 / duration,
+	       n_updates ? (double)n_attempts / n_updates : 0,
+	       n_updates ? n_acked * 100.0 / n_updates : 0);
+	printf("packets sent: %lu, send errors: %lu, other frames: %lu\n",
+	       n_sent, n_send_err, n_other);
+
+	if (json)
+		fprintf(json, "{\n\t\"duration_ms\": %u,\n"
+			"\t\"status_updates\": %lu,\n"
+			"\t\"attempts\": %lu,\n"
+			"\t\"acked\": %lu,\n",
+			duration, n_updates, n_attempts, n_acked);
+
+	for (i = 0; profiled && i < sizeof(profile) / sizeof(profile[0]); i++) {
+		double ns = profile[i].hits ? profile[i].usecs * 1000 / profile[i].hits : 0;
+
+		printf("%s: %lu calls, %.0f ns per call\n",
+		       profile[i].func, profile[i].hits, ns);
+		if (json)
+			fprintf(json, "\t\"%s_calls\": %lu,\n"
+				"\t\"%s_ns\": %.1f,\n",
+				profile[i].func, profile[i].hits, profile[i].func, ns);
+	}
+
+	if (json)
+		fprintf(json, "\t\"phases\": [\n");
+
+	for (p = 0; p < n_phases; p++) {
+		struct phase_result res;
+
+		phase_result(p, duration, &res);
+		if (res.start >= duration)
+			break;
+
+		printf("phase %d (%u-%u ms): best %s at %.1f Mbit/s, ",
+		       p, res.start, res.end, res.best ? res.best->name : "-", res.opt);
+		if (res.converged >= 0)
+			printf("converged after %d ms", res.converged);
+		else
+			printf("not converged");
+		printf(", score %.2f, goodput %.1f Mbit/s\n", res.score, res.goodput);
+
+		if (json)
+			fprintf(json, "\t\t{ \"start_ms\": %u, \"end_ms\": %u, "
+				"\"best\": \"%s\", \"optimal_mbps\": %.2f, "
+				"\"converged_ms\": %d, \"score\": %.3f, "
+				"\"goodput_mbps\": %.2f }%s\n",
+				res.start, res.end, res.best ? res.best->name : "",
+				res.opt, res.converged, res.score, res.goodput,
+				p + 1 < n_phases && phase_start[p + 1] < duration ? "," : "");
+	}
+
+	if (json)
+		fprintf(json, "\t]\n}\n");
+}
+
+static void handle_signal(int sig)
+{
+	stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *setup = DEFAULT_SETUP, *chan = DEFAULT_CHAN, *out = NULL;
+	unsigned int duration = 0, pps = 2000, next_tick = 0, end;
+	long seed = 1;
+	struct nl_cb *cb;
+	struct pollfd pfd[1];
+	pid_t setup_pid;
+	bool profiled = false;
+	int traffic = -1, ret = 1;
+	int i, ch;
+
+	while ((ch = getopt(argc, argv, "c:d:o:p:s:S:t:w:x:")) != -1) {
+		switch (ch) {
+		case 'c':
+			chan = optarg;
+			break;
+		case 'd':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'p':
+			pps = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			payload_len = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			threshold = strtod(optarg, NULL);
+			break;
+		case 'w':
+			window_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			setup = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc || !pps || !payload_len || payload_len > MAX_PAYLOAD)
+		usage(argv[0]);
+
+	if (load_trace(argv[optind]))
+		return 1;
+
+	if (!duration)
+		duration = events[n_events - 1].time + 10000;
+
+	srand48(seed);
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	sk = nl_socket_alloc();
+	if (!sk || genl_connect(sk)) {
+		fprintf(stderr, "Failed to connect to generic netlink\n");
+		return 1;
+	}
+
+	nl_socket_set_buffer_size(sk, 1 << 20, 1 << 20);
+
+	family = genl_ctrl_resolve(sk, "MAC80211_HWSIM");
+	if (family < 0) {
+		fprintf(stderr, "mac80211_hwsim not loaded\n");
+		goto out;
+	}
+
+	if (send_and_wait(hwsim_msg(HWSIM_CMD_REGISTER))) {
+		fprintf(stderr, "Failed to register as medium, is wmediumd running?\n");
+		goto out;
+	}
+
+	for (i = 0; i < N_RADIOS; i++) {
+		if (hwsim_new_radio(i)) {
+			fprintf(stderr, "Failed to create radio %s\n", radio_name[i]);
+			goto out;
+		}
+	}
+
+	cb = nl_cb_alloc(NL_CB_DEFAULT);
+	nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, no_seq_check, NULL);
+	nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, frame_handler, NULL);
+	nl_socket_set_nonblocking(sk);
+
+	pfd[0].fd = nl_socket_get_fd(sk);
+	pfd[0].events = POLLIN;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	setup_pid = run_setup(setup, chan);
+	if (setup_pid < 0) {
+		perror("fork");
+		goto out_cb;
+	}
+
+	while (!stop) {
+		unsigned int now;
+
+		if (setup_pid > 0) {
+			int status;
+
+			if (waitpid(setup_pid, &status, WNOHANG) == setup_pid) {
+				setup_pid = 0;
+				if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+					fprintf(stderr, "Setup command failed\n");
+					goto out_cb;
+				}
+
+				traffic = traffic_open();
+				if (traffic < 0)
+					goto out_cb;
+
+				profiled = profile_start();
+				clock_gettime(CLOCK_MONOTONIC, &t_start);
+				running = true;
+			}
+		}
+
+		now = now_ms();
+		if (running && now >= duration)
+			break;
+
+		if (running && now >= next_tick) {
+			unsigned int n = pps / 100 ? pps / 100 : 1;
+			static char buf[MAX_PAYLOAD];
+
+			while (n--) {
+				if (send(traffic, buf, payload_len, 0) < 0)
+					n_send_err++;
+				else
+					n_sent++;
+			}
+			next_tick = now + 10;
+		}
+
+		if (poll(pfd, 1, running ? 10 : 100) > 0)
+			nl_recvmsgs(sk, cb);
+	}
+
+	end = now_ms();
+	if (running) {
+		update_time();
+		bin_close();
+		if (profiled)
+			profile_stop();
+	}
+
+	if (setup_pid > 0) {
+		kill(setup_pid, SIGTERM);
+		waitpid(setup_pid, NULL, 0);
+	}
+
+	if (running) {
+		FILE *json = NULL;
+
+		if (out) {
+			json = fopen(out, "w");
+			if (!json)
+				perror(out);
+		}
+
+		report(json, end < duration ? end : duration, profiled);
+		if (json)
+			fclose(json);
+		ret = 0;
+	}
+
+out_cb:
+	if (traffic >= 0)
+		close(traffic);
+	nl_cb_put(cb);
+out:
+	/* the radios are removed when the socket is closed */
+	nl_socket_free(sk);
+
+	return ret;
+}
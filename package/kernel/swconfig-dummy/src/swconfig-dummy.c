@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * swconfig-dummy.c: swconfig switch without hardware
+ *
+ * Keeps the VLAN and port configuration in memory, so that swconfig and
+ * its uci loader can be tested and timed on any device. Every register
+ * write that a real driver would do on apply can be slowed down with the
+ * write_delay parameter to mimic an MDIO bus.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/switch.h>
+
+static unsigned int ports = 7;
+module_param(ports, uint, 0444);
+MODULE_PARM_DESC(ports, "Number of switch ports");
+
+static unsigned int vlans = 16;
+module_param(vlans, uint, 0444);
+MODULE_PARM_DESC(vlans, "Number of VLAN table entries");
+
+static unsigned int write_delay;
+module_param(write_delay, uint, 0644);
+MODULE_PARM_DESC(write_delay, "Delay per emulated register write (us)");
+
+struct dummy_vlan {
+	u16 vid;
+	u32 members;
+	u32 tagged;
+};
+
+struct dummy_switch {
+	struct switch_dev dev;
+	bool enable_vlan;
+	int *pvid;
+	struct dummy_vlan *vlan;
+	unsigned int sets;
+	unsigned int applies;
+	unsigned int writes;
+};
+
+#define to_dummy(_dev) container_of(_dev, struct dummy_switch, dev)
+
+static struct dummy_switch *dummy;
+
+static void
+dummy_write(struct dummy_switch *sw)
+{
+	sw->writes++;
+	if (write_delay)
+		udelay(write_delay);
+}
+
+static int
+dummy_set_enable_vlan(struct switch_dev *dev, const struct switch_attr *attr,
+		      struct switch_val *val)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+
+	sw->sets++;
+	sw->enable_vlan = !!val->value.i;
+	return 0;
+}
+
+static int
+dummy_get_enable_vlan(struct switch_dev *dev, const struct switch_attr *attr,
+		      struct switch_val *val)
+{
+	val->value.i = to_dummy(dev)->enable_vlan;
+	return 0;
+}
+
+static int
+dummy_get_stats(struct switch_dev *dev, const struct switch_attr *attr,
+		struct switch_val *val)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+
+	snprintf(dev->buf, sizeof(dev->buf), "sets: %u applies: %u writes: %u",
+		 sw->sets, sw->applies, sw->writes);
+	val->value.s = dev->buf;
+	return 0;
+}
+
+static int
+dummy_set_vid(struct switch_dev *dev, const struct switch_attr *attr,
+	      struct switch_val *val)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+
+	if (val->value.i < 0 || val->value.i > 4095)
+		return -EINVAL;
+
+	sw->sets++;
+	sw->vlan[val->port_vlan].vid = val->value.i;
+	return 0;
+}
+
+static int
+dummy_get_vid(struct switch_dev *dev, const struct switch_attr *attr,
+	      struct switch_val *val)
+{
+	val->value.i = to_dummy(dev)->vlan[val->port_vlan].vid;
+	return 0;
+}
+
+static int
+dummy_get_vlan_ports(struct switch_dev *dev, struct switch_val *val)
+{
+	struct dummy_vlan *v = &to_dummy(dev)->vlan[val->port_vlan];
+	int i;
+
+	val->len = 0;
+	for (i = 0; i < dev->ports; i++) {
+		struct switch_port *p;
+
+		if (!(v->members & BIT(i)))
+			continue;
+
+		p = &val->value.ports[val->len++];
+		p->id = i;
+		p->flags = (v->tagged & BIT(i)) ? BIT(SWITCH_PORT_FLAG_TAGGED) : 0;
+	}
+
+	return 0;
+}
+
+static int
+dummy_set_vlan_ports(struct switch_dev *dev, struct switch_val *val)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+	struct dummy_vlan *v = &sw->vlan[val->port_vlan];
+	int i;
+
+	for (i = 0; i < val->len; i++)
+		if (val->value.ports[i].id >= dev->ports)
+			return -EINVAL;
+
+	v->members = 0;
+	v->tagged = 0;
+	for (i = 0; i < val->len; i++) {
+		struct switch_port *p = &val->value.ports[i];
+
+		v->members |= BIT(p->id);
+		if (p->flags & BIT(SWITCH_PORT_FLAG_TAGGED))
+			v->tagged |= BIT(p->id);
+		else
+			sw->pvid[p->id] = val->port_vlan;
+	}
+	sw->sets++;
+
+	return 0;
+}
+
+static int
+dummy_get_port_pvid(struct switch_dev *dev, int port, int *val)
+{
+	*val = to_dummy(dev)->pvid[port];
+	return 0;
+}
+
+static int
+dummy_set_port_pvid(struct switch_dev *dev, int port, int val)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+
+	if (val < 0 || val >= dev->vlans)
+		return -EINVAL;
+
+	sw->sets++;
+	sw->pvid[port] = val;
+	return 0;
+}
+
+static int
+dummy_apply_config(struct switch_dev *dev)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+	int i;
+
+	sw->applies++;
+
+	/* one write per VLAN table entry and per port, like most drivers */
+	for (i = 0; i < dev->vlans; i++)
+		dummy_write(sw);
+	for (i = 0; i < dev->ports; i++)
+		dummy_write(sw);
+	dummy_write(sw);
+
+	return 0;
+}
+
+static int
+dummy_reset_switch(struct switch_dev *dev)
+{
+	struct dummy_switch *sw = to_dummy(dev);
+	int i;
+
+	sw->enable_vlan = false;
+	memset(sw->pvid, 0, sizeof(*sw->pvid) * dev->ports);
+	memset(sw->vlan, 0, sizeof(*sw->vlan) * dev->vlans);
+	for (i = 0; i < dev->vlans; i++)
+		sw->vlan[i].vid = i;
+
+	return dummy_apply_config(dev);
+}
+
+static struct switch_attr dummy_globals[] = {
+	{
+		.type = SWITCH_TYPE_INT,
+		.name = "enable_vlan",
+		.description = "Enable VLAN mode",
+		.set = dummy_set_enable_vlan,
+		.get = dummy_get_enable_vlan,
+		.max = 1,
+	}, {
+		.type = SWITCH_TYPE_STRING,
+		.name = "stats",
+		.description = "Number of attribute sets, applies and register writes",
+		.get = dummy_get_stats,
+	},
+};
+
+static struct switch_attr dummy_vlan_attrs[] = {
+	{
+		.type = SWITCH_TYPE_INT,
+		.name = "vid",
+		.description = "VLAN ID (0-4094)",
+		.set = dummy_set_vid,
+		.get = dummy_get_vid,
+		.max = 4094,
+	},
+};
+
+static const struct switch_dev_ops dummy_ops = {
+	.attr_global = {
+		.attr = dummy_globals,
+		.n_attr = ARRAY_SIZE(dummy_globals),
+	},
+	.attr_vlan = {
+		.attr = dummy_vlan_attrs,
+		.n_attr = ARRAY_SIZE(dummy_vlan_attrs),
+	},
+	.get_vlan_ports = dummy_get_vlan_ports,
+	.set_vlan_ports = dummy_set_vlan_ports,
+	.get_port_pvid = dummy_get_port_pvid,
+	.set_port_pvid = dummy_set_port_pvid,
+	.apply_config = dummy_apply_config,
+	.reset_switch = dummy_reset_switch,
+};
+
+static int __init
+dummy_init(void)
+{
+	int err;
+
+	if (!ports || ports > 32 || !vlans)
+		return -EINVAL;
+
+	dummy = kzalloc(sizeof(*dummy), GFP_KERNEL);
+	if (!dummy)
+		return -ENOMEM;
+
+	dummy->pvid = kcalloc(ports, sizeof(*dummy->pvid), GFP_KERNEL);
+	dummy->vlan = kcalloc(vlans, sizeof(*dummy->vlan), GFP_KERNEL);
+	if (!dummy->pvid || !dummy->vlan) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	dummy->dev.name = "dummy";
+	dummy->dev.alias = "switch-dummy";
+	dummy->dev.ops = &dummy_ops;
+	dummy->dev.ports = ports;
+	dummy->dev.vlans = vlans;
+	dummy->dev.cpu_port = ports - 1;
+
+	err = register_switch(&dummy->dev, NULL);
+	if (err)
+		goto error;
+
+	dummy_reset_switch(&dummy->dev);
+	return 0;
+
+error:
+	kfree(dummy->vlan);
+	kfree(dummy->pvid);
+	kfree(dummy);
+	return err;
+}
+
+static void __exit
+dummy_exit(void)
+{
+	unregister_switch(&dummy->dev);
+	kfree(dummy->vlan);
+	kfree(dummy->pvid);
+	kfree(dummy);
+}
+
+module_init(dummy_init);
+module_exit(dummy_exit);
+MODULE_DESCRIPTION("swconfig switch without hardware");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XDP fast path for trelay
+ *
+ * Redirects every frame received on one device of a relay to the other
+ * one, except EAPOL frames, which are passed up to the stack. Frames that
+ * can not be redirected are passed as well and handled by the trelay
+ * kernel module.
+ */
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "trelay-bpf.h"
+
+/* ingress ifindex -> egress ifindex */
+struct {
+	__uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
+	__uint(key_size, sizeof(__u32));
+	__uint(value_size, sizeof(__u32));
+	__uint(max_entries, 2);
+} peers SEC(".maps");
+
+/* ingress ifindex -> counters */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+	__uint(key_size, sizeof(__u32));
+	__uint(value_size, sizeof(struct trelay_xdp_stats));
+	__uint(max_entries, 2);
+} stats SEC(".maps");
+
+SEC("xdp")
+int trelay_xdp(struct xdp_md *ctx)
+{
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	__u32 ifindex = ctx->ingress_ifindex;
+	struct trelay_xdp_stats *st;
+	struct ethhdr *eth = data;
+
+	if ((void *)(eth + 1) > data_end)
+		return XDP_PASS;
+
+	st = bpf_map_lookup_elem(&stats, &ifindex);
+	if (!st)
+		return XDP_PASS;
+
+	if (eth->h_proto == bpf_htons(ETH_P_PAE)) {
+		st->passed++;
+		return XDP_PASS;
+	}
+
+	st->packets++;
+	st->bytes += data_end - data;
+
+	return bpf_redirect_map(&peers, ifindex, XDP_PASS);
+}
+
+char _license[] SEC("license") = "GPL";
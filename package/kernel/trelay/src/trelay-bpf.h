@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef __TRELAY_BPF_H
+#define __TRELAY_BPF_H
+
+struct trelay_xdp_stats {
+	__u64 packets;
+	__u64 bytes;
+	__u64 passed;
+};
+
+#endif
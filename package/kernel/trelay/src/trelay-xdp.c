@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * trelay-xdp: attach the trelay XDP fast path to a pair of devices
+ *
+ * The program is only attached if both drivers support native XDP with
+ * redirect and ndo_xdp_xmit, so that frames never fall back to generic
+ * XDP. The counter map is pinned below /sys/fs/bpf/trelay, one file per
+ * relay, and is used to find the devices again on stop.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/stat.h>
+#include <linux/if_link.h>
+#include <linux/netdev.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "trelay-bpf.h"
+
+#define TRELAY_BPF_OBJ	"/lib/bpf/trelay-bpf.o"
+#define TRELAY_PIN_DIR	"/sys/fs/bpf/trelay"
+
+#define XDP_FEATURES	(NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT | \
+			 NETDEV_XDP_ACT_NDO_XMIT)
+
+static char pin_path[256];
+
+static int xdp_supported(int ifindex)
+{
+	LIBBPF_OPTS(bpf_xdp_query_opts, opts);
+
+	if (bpf_xdp_query(ifindex, 0, &opts))
+		return 0;
+
+	return (opts.feature_flags & XDP_FEATURES) == XDP_FEATURES;
+}
+
+static int get_ifindex(const char *name)
+{
+	int ifindex = if_nametoindex(name);
+
+	if (!ifindex)
+		fprintf(stderr, "Device %s not found\n", name);
+	else if (!xdp_supported(ifindex))
+		fprintf(stderr, "Device %s does not support XDP redirect\n", name);
+	else
+		return ifindex;
+
+	return 0;
+}
+
+static int init_maps(struct bpf_object *obj, int *ifindex)
+{
+	struct trelay_xdp_stats *st;
+	int peers, stats, ncpus, i;
+	int ret = 0;
+
+	peers = bpf_object__find_map_fd_by_name(obj, "peers");
+	stats = bpf_object__find_map_fd_by_name(obj, "stats");
+	ncpus = libbpf_num_possible_cpus();
+	if (peers < 0 || stats < 0 || ncpus < 0)
+		return -ENOENT;
+
+	st = calloc(ncpus, sizeof(*st));
+	if (!st)
+		return -ENOMEM;
+
+	for (i = 0; i < 2 && !ret; i++) {
+		__u32 key = ifindex[i], val = ifindex[!i];
+
+		ret = bpf_map_update_elem(peers, &key, &val, BPF_ANY);
+		if (!ret)
+			ret = bpf_map_update_elem(stats, &key, st, BPF_ANY);
+	}
+	free(st);
+
+	return ret;
+}
+
+static int trelay_xdp_start(const char *dev1, const char *dev2)
+{
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	int ifindex[2];
+	int prog_fd, ret;
+
+	ifindex[0] = get_ifindex(dev1);
+	ifindex[1] = get_ifindex(dev2);
+	if (!ifindex[0] || !ifindex[1])
+		return 1;
+
+	obj = bpf_object__open_file(TRELAY_BPF_OBJ, NULL);
+	if (!obj) {
+		perror("Failed to open " TRELAY_BPF_OBJ);
+		return 1;
+	}
+
+	ret = bpf_object__load(obj);
+	if (ret)
+		goto out;
+
+	ret = init_maps(obj, ifindex);
+	if (ret)
+		goto out;
+
+	prog = bpf_object__find_program_by_name(obj, "trelay_xdp");
+	if (!prog) {
+		ret = -ENOENT;
+		goto out;
+	}
+	prog_fd = bpf_program__fd(prog);
+
+	ret = bpf_xdp_attach(ifindex[0], prog_fd, XDP_FLAGS_DRV_MODE, NULL);
+	if (ret)
+		goto out;
+
+	ret = bpf_xdp_attach(ifindex[1], prog_fd, XDP_FLAGS_DRV_MODE, NULL);
+	if (ret) {
+		bpf_xdp_detach(ifindex[0], XDP_FLAGS_DRV_MODE, NULL);
+		goto out;
+	}
+
+	mkdir(TRELAY_PIN_DIR, 0700);
+	ret = bpf_map__pin(bpf_object__find_map_by_name(obj, "stats"), pin_path);
+	if (ret) {
+		bpf_xdp_detach(ifindex[0], XDP_FLAGS_DRV_MODE, NULL);
+		bpf_xdp_detach(ifindex[1], XDP_FLAGS_DRV_MODE, NULL);
+	}
+
+out:
+	if (ret)
+		fprintf(stderr, "Failed to attach XDP program: %s\n", strerror(-ret));
+	bpf_object__close(obj);
+
+	return !!ret;
+}
+
+static int trelay_xdp_stop(void)
+{
+	__u32 key, *prev = NULL;
+	int fd;
+
+	fd = bpf_obj_get(pin_path);
+	if (fd < 0)
+		return 1;
+
+	while (!bpf_map_get_next_key(fd, prev, &key)) {
+		bpf_xdp_detach(key, XDP_FLAGS_DRV_MODE, NULL);
+		prev = &key;
+	}
+
+	close(fd);
+	unlink(pin_path);
+
+	return 0;
+}
+
+static int trelay_xdp_stats(void)
+{
+	struct trelay_xdp_stats *st;
+	__u32 key, *prev = NULL;
+	int fd, ncpus, i;
+
+	fd = bpf_obj_get(pin_path);
+	ncpus = libbpf_num_possible_cpus();
+	if (fd < 0 || ncpus < 0)
+		return 1;
+
+	st = calloc(ncpus, sizeof(*st));
+	if (!st)
+		return 1;
+
+	while (!bpf_map_get_next_key(fd, prev, &key)) {
+		struct trelay_xdp_stats sum = {};
+		char ifname[IF_NAMESIZE];
+
+		prev = &key;
+		if (bpf_map_lookup_elem(fd, &key, st))
+			continue;
+
+		for (i = 0; i < ncpus; i++) {
+			sum.packets += st[i].packets;
+			sum.bytes += st[i].bytes;
+			sum.passed += st[i].passed;
+		}
+
+		if (!if_indextoname(key, ifname))
+			snprintf(ifname, sizeof(ifname), "%u", key);
+
+		printf("%s:\n\tredirected_packets: %llu\n\tredirected_bytes: %llu\n"
+		       "\tpassed: %llu\n", ifname,
+		       (unsigned long long)sum.packets,
+		       (unsigned long long)sum.bytes,
+		       (unsigned long long)sum.passed);
+	}
+
+	free(st);
+	close(fd);
+
+	return 0;
+}
+
+static int usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s start <name> <dev1> <dev2>\n"
+			"       %s stop <name>\n"
+			"       %s stats <name>\n",
+		progname, progname, progname);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		return usage(argv[0]);
+
+	snprintf(pin_path, sizeof(pin_path), TRELAY_PIN_DIR "/%s", argv[2]);
+
+	if (!strcmp(argv[1], "start") && argc == 5)
+		return trelay_xdp_start(argv[3], argv[4]);
+	if (!strcmp(argv[1], "stop"))
+		return trelay_xdp_stop();
+	if (!strcmp(argv[1], "stats"))
+		return trelay_xdp_stats();
+
+	return usage(argv[0]);
+}
@@ -19,6 +19,10 @@
 #include <linux/netdevice.h>
 #include <linux/rtnetlink.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/workqueue.h>
+#include <linux/delay.h>
 
 #define trelay_log(loglevel, tr, fmt, ...) \
 	printk(loglevel "trelay: %s <-> %s: " fmt "\n", \
@@ -26,31 +30,275 @@
 
 static LIST_HEAD(trelay_devs);
 static struct dentry *debugfs_dir;
+static struct workqueue_struct *trelay_wq;
+
+static bool batch;
+module_param(batch, bool, 0644);
+MODULE_PARM_DESC(batch, "Enable batched transmit for new relays");
+
+static unsigned int backlog = 1000;
+module_param(backlog, uint, 0644);
+MODULE_PARM_DESC(backlog, "Maximum number of queued frames per CPU in batch mode");
+
+struct trelay_stats {
+	u64_stats_t rx_packets;
+	u64_stats_t rx_bytes;
+	u64_stats_t tx_packets;
+	u64_stats_t tx_bytes;
+	u64_stats_t tx_dropped;
+	u64_stats_t passed;
+	struct u64_stats_sync syncp;
+	/* frames sitting in the batch queue of this CPU */
+	unsigned long queued;
+};
+
+/* one direction of a relay, used as rx_handler_data of the receiving device */
+struct trelay_port {
+	struct trelay *tr;
+	struct net_device *peer;
+	struct trelay_stats __percpu *stats;
+};
 
 struct trelay {
 	struct list_head list;
 	struct net_device *dev1, *dev2;
+	struct trelay_port port[2];
 	struct dentry *debugfs;
+	struct rcu_work free_work;
+	bool batch;
 	int to_remove;
 	char name[];
 };
 
+/*
+ * In batch mode, relayed frames are queued per CPU and sent from a NAPI
+ * poll that runs after the receiving driver has finished its own poll.
+ * This allows handing frames to the driver with xmit_more set, so that
+ * it only needs to kick the hardware once per burst.
+ */
+struct trelay_cpu {
+	struct sk_buff_head queue;
+	struct napi_struct napi;
+};
+
+static DEFINE_PER_CPU(struct trelay_cpu, trelay_cpu);
+static struct net_device *napi_dev;
+
+#define TRELAY_CB(skb) (*(struct trelay_port **)(skb)->cb)
+
+#define trelay_count(port, field)					\
+	do {								\
+		struct trelay_stats *__stats = this_cpu_ptr((port)->stats); \
+									\
+		u64_stats_update_begin(&__stats->syncp);		\
+		u64_stats_inc(&__stats->field);				\
+		u64_stats_update_end(&__stats->syncp);			\
+	} while (0)
+
+#define trelay_count_bytes(port, field, len)				\
+	do {								\
+		struct trelay_stats *__stats = this_cpu_ptr((port)->stats); \
+									\
+		u64_stats_update_begin(&__stats->syncp);		\
+		u64_stats_inc(&__stats->field##_packets);		\
+		u64_stats_add(&__stats->field##_bytes, len);		\
+		u64_stats_update_end(&__stats->syncp);			\
+	} while (0)
+
+static void trelay_xmit(struct trelay_port *port, struct sk_buff *skb)
+{
+	unsigned int len = skb->len;
+
+	if (net_xmit_eval(dev_queue_xmit(skb)))
+		trelay_count(port, tx_dropped);
+	else
+		trelay_count_bytes(port, tx, len);
+}
+
+static void trelay_queue(struct trelay_port *port, struct sk_buff *skb)
+{
+	struct trelay_cpu *tc;
+
+	local_bh_disable();
+	tc = this_cpu_ptr(&trelay_cpu);
+	if (skb_queue_len(&tc->queue) >= READ_ONCE(backlog)) {
+		trelay_count(port, tx_dropped);
+		kfree_skb(skb);
+		goto out;
+	}
+
+	TRELAY_CB(skb) = port;
+	this_cpu_ptr(port->stats)->queued++;
+	__skb_queue_tail(&tc->queue, skb);
+	napi_schedule(&tc->napi);
+
+out:
+	local_bh_enable();
+}
+
+/*
+ * Frames that need segmentation or other fixups, and devices that select
+ * the tx queue themselves, take the regular path
+ */
+static bool trelay_needs_fixup(struct sk_buff *skb, netdev_features_t features)
+{
+	if (skb->dev->netdev_ops->ndo_select_queue)
+		return true;
+
+	if (netif_needs_gso(skb, features))
+		return true;
+
+	if (skb_vlan_tag_present(skb) &&
+	    !(features & (NETIF_F_HW_VLAN_CTAG_TX | NETIF_F_HW_VLAN_STAG_TX)))
+		return true;
+
+	if (skb_has_frag_list(skb) && !(features & NETIF_F_FRAGLIST))
+		return true;
+
+	if (skb_shinfo(skb)->nr_frags && !(features & NETIF_F_SG))
+		return true;
+
+	return false;
+}
+
+/* must be the last access to the port of a queued frame */
+static void trelay_unqueue(struct trelay_port *port)
+{
+	struct trelay_stats *stats = this_cpu_ptr(port->stats);
+
+	smp_store_release(&stats->queued, stats->queued - 1);
+}
+
+static bool trelay_prepare(struct sk_buff *skb)
+{
+	struct trelay_port *port = TRELAY_CB(skb);
+	struct net_device *dev = skb->dev;
+	netdev_features_t features;
+	u16 index = 0;
+
+	features = netif_skb_features(skb);
+	if (trelay_needs_fixup(skb, features)) {
+		trelay_xmit(port, skb);
+		trelay_unqueue(port);
+		return false;
+	}
+
+	if (skb_csum_hwoffload_help(skb, features)) {
+		trelay_count(port, tx_dropped);
+		trelay_unqueue(port);
+		kfree_skb(skb);
+		return false;
+	}
+
+	if (dev->real_num_tx_queues > 1)
+		index = netdev_pick_tx(dev, skb, NULL);
+	skb_set_queue_mapping(skb, index);
+	skb_reset_mac_header(skb);
+
+	return true;
+}
+
+/*
+ * Send a batch of frames directly to the drivers, bypassing the qdisc of
+ * the target device, like pktgen does. Consecutive frames for the same tx
+ * queue are sent under one lock, all but the last one with xmit_more set.
+ */
+static void trelay_xmit_list(struct sk_buff_head *list)
+{
+	struct netdev_queue *txq = NULL;
+	struct net_device *dev = NULL;
+	int cpu = smp_processor_id();
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct trelay_port *port = TRELAY_CB(skb);
+		struct sk_buff *next = skb_peek(list);
+		u16 index = skb_get_queue_mapping(skb);
+		unsigned int len = skb->len;
+		bool more;
+		int ret;
+
+		if (txq && (skb->dev != dev ||
+			    txq != netdev_get_tx_queue(dev, index))) {
+			HARD_TX_UNLOCK(dev, txq);
+			txq = NULL;
+		}
+
+		if (!txq) {
+			dev = skb->dev;
+			txq = netdev_get_tx_queue(dev, index);
+			HARD_TX_LOCK(dev, txq, cpu);
+		}
+
+		if (!netif_running(dev) ||
+		    netif_xmit_frozen_or_drv_stopped(txq)) {
+			kfree_skb(skb);
+			ret = NET_XMIT_DROP;
+		} else {
+			more = next && next->dev == dev &&
+			       skb_get_queue_mapping(next) == index;
+			ret = netdev_start_xmit(skb, dev, txq, more);
+			if (!dev_xmit_complete(ret))
+				kfree_skb(skb);
+		}
+
+		if (ret == NETDEV_TX_OK)
+			trelay_count_bytes(port, tx, len);
+		else
+			trelay_count(port, tx_dropped);
+		trelay_unqueue(port);
+	}
+
+	if (txq)
+		HARD_TX_UNLOCK(dev, txq);
+}
+
+static int trelay_poll(struct napi_struct *napi, int budget)
+{
+	struct trelay_cpu *tc = container_of(napi, struct trelay_cpu, napi);
+	struct sk_buff_head list;
+	struct sk_buff *skb;
+	int work = 0;
+
+	__skb_queue_head_init(&list);
+	while (work < budget && (skb = __skb_dequeue(&tc->queue)) != NULL) {
+		if (trelay_prepare(skb))
+			__skb_queue_tail(&list, skb);
+		work++;
+	}
+
+	trelay_xmit_list(&list);
+
+	if (work < budget)
+		napi_complete_done(napi, work);
+
+	return work;
+}
+
 static rx_handler_result_t trelay_handle_frame(struct sk_buff **pskb)
 {
-	struct net_device *dev;
+	struct trelay_port *port;
 	struct sk_buff *skb = *pskb;
 
-	dev = rcu_dereference(skb->dev->rx_handler_data);
-	if (!dev)
+	port = rcu_dereference(skb->dev->rx_handler_data);
+	if (!port)
 		return RX_HANDLER_PASS;
 
-	if (skb->protocol == htons(ETH_P_PAE))
+	if (skb->protocol == htons(ETH_P_PAE)) {
+		trelay_count(port, passed);
 		return RX_HANDLER_PASS;
+	}
 
 	skb_push(skb, ETH_HLEN);
-	skb->dev = dev;
+	trelay_count_bytes(port, rx, skb->len);
+
+	skb->dev = port->peer;
 	skb_forward_csum(skb);
-	dev_queue_xmit(skb);
+
+	if (READ_ONCE(port->tr->batch))
+		trelay_queue(port, skb);
+	else
+		trelay_xmit(port, skb);
 
 	return RX_HANDLER_CONSUMED;
 }
@@ -61,6 +309,89 @@ static int trelay_open(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static int trelay_stats_show(struct seq_file *s, void *data)
+{
+	struct trelay *tr = s->private;
+	int i, cpu;
+
+	for (i = 0; i < ARRAY_SIZE(tr->port); i++) {
+		struct trelay_port *port = &tr->port[i];
+		u64 rx_packets = 0, rx_bytes = 0, tx_packets = 0, tx_bytes = 0;
+		u64 tx_dropped = 0, passed = 0;
+
+		for_each_possible_cpu(cpu) {
+			const struct trelay_stats *stats = per_cpu_ptr(port->stats, cpu);
+			u64 rxp, rxb, txp, txb, txd, pass;
+			unsigned int start;
+
+			do {
+				start = u64_stats_fetch_begin(&stats->syncp);
+				rxp = u64_stats_read(&stats->rx_packets);
+				rxb = u64_stats_read(&stats->rx_bytes);
+				txp = u64_stats_read(&stats->tx_packets);
+				txb = u64_stats_read(&stats->tx_bytes);
+				txd = u64_stats_read(&stats->tx_dropped);
+				pass = u64_stats_read(&stats->passed);
+			} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+			rx_packets += rxp;
+			rx_bytes += rxb;
+			tx_packets += txp;
+			tx_bytes += txb;
+			tx_dropped += txd;
+			passed += pass;
+		}
+
+		seq_printf(s, "%s -> %s:\n",
+			   i ? tr->dev2->name : tr->dev1->name, port->peer->name);
+		seq_printf(s, "\trx_packets: %llu\n\trx_bytes: %llu\n",
+			   rx_packets, rx_bytes);
+		seq_printf(s, "\ttx_packets: %llu\n\ttx_bytes: %llu\n",
+			   tx_packets, tx_bytes);
+		seq_printf(s, "\ttx_dropped: %llu\n\tpassed: %llu\n",
+			   tx_dropped, passed);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(trelay_stats);
+
+static unsigned long trelay_queued(struct trelay *tr)
+{
+	unsigned long queued = 0;
+	int i, cpu;
+
+	for (i = 0; i < ARRAY_SIZE(tr->port); i++)
+		for_each_possible_cpu(cpu)
+			queued += smp_load_acquire(&per_cpu_ptr(tr->port[i].stats, cpu)->queued);
+
+	return queued;
+}
+
+/*
+ * Runs after an RCU grace period following the rx handler removal, so no
+ * new frames can be queued for the relay. Frames still waiting in the
+ * batch queues refer to it and to its devices, wait for the NAPI polls
+ * to send them without holding RTNL.
+ */
+static void trelay_free(struct work_struct *work)
+{
+	struct trelay *tr = container_of(to_rcu_work(work), struct trelay,
+					 free_work);
+
+	while (trelay_queued(tr))
+		msleep(1);
+
+	trelay_log(KERN_INFO, tr, "stopped");
+
+	dev_put(tr->dev1);
+	dev_put(tr->dev2);
+
+	free_percpu(tr->port[0].stats);
+	free_percpu(tr->port[1].stats);
+	kfree(tr);
+}
+
 static int trelay_do_remove(struct trelay *tr)
 {
 	list_del(&tr->list);
@@ -69,15 +400,11 @@ static int trelay_do_remove(struct trelay *tr)
 	 * to prevent dangling pointer in file->private_data */
 	debugfs_remove_recursive(tr->debugfs);
 
-	dev_put(tr->dev1);
-	dev_put(tr->dev2);
-
 	netdev_rx_handler_unregister(tr->dev1);
 	netdev_rx_handler_unregister(tr->dev2);
 
-	trelay_log(KERN_INFO, tr, "stopped");
-
-	kfree(tr);
+	INIT_RCU_WORK(&tr->free_work, trelay_free);
+	queue_rcu_work(trelay_wq, &tr->free_work);
 
 	return 0;
 }
@@ -156,6 +483,13 @@ static int trelay_do_add(char *name, char *devn1, char *devn2)
 	if (!tr)
 		return -ENOMEM;
 
+	tr->port[0].stats = netdev_alloc_pcpu_stats(struct trelay_stats);
+	tr->port[1].stats = netdev_alloc_pcpu_stats(struct trelay_stats);
+	if (!tr->port[0].stats || !tr->port[1].stats) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
 	rtnl_lock();
 	rcu_read_lock();
 
@@ -171,11 +505,17 @@ static int trelay_do_add(char *name, char *devn1, char *devn2)
 	if (!dev1 || !dev2)
 		goto out;
 
-	ret = netdev_rx_handler_register(dev1, trelay_handle_frame, dev2);
+	tr->port[0].tr = tr;
+	tr->port[0].peer = dev2;
+	tr->port[1].tr = tr;
+	tr->port[1].peer = dev1;
+	tr->batch = READ_ONCE(batch);
+
+	ret = netdev_rx_handler_register(dev1, trelay_handle_frame, &tr->port[0]);
 	if (ret < 0)
 		goto out;
 
-	ret = netdev_rx_handler_register(dev2, trelay_handle_frame, dev1);
+	ret = netdev_rx_handler_register(dev2, trelay_handle_frame, &tr->port[1]);
 	if (ret < 0) {
 		netdev_rx_handler_unregister(dev1);
 		goto out;
@@ -193,13 +533,20 @@ static int trelay_do_add(char *name, char *devn1, char *devn2)
 
 	tr->debugfs = debugfs_create_dir(name, debugfs_dir);
 	debugfs_create_file("remove", S_IWUSR, tr->debugfs, tr, &fops_remove);
+	debugfs_create_file("stats", S_IRUSR, tr->debugfs, tr, &trelay_stats_fops);
+	debugfs_create_bool("batch", S_IRUSR | S_IWUSR, tr->debugfs, &tr->batch);
 	ret = 0;
 
 out:
 	rcu_read_unlock();
 	rtnl_unlock();
-	if (ret < 0)
-		kfree(tr);
+	if (!ret)
+		return 0;
+
+error:
+	free_percpu(tr->port[0].stats);
+	free_percpu(tr->port[1].stats);
+	kfree(tr);
 
 	return ret;
 }
@@ -254,14 +601,58 @@ static struct notifier_block tr_dev_notifier = {
 	.notifier_call = tr_device_event
 };
 
+static void trelay_napi_cleanup(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct trelay_cpu *tc = per_cpu_ptr(&trelay_cpu, cpu);
+
+		napi_disable(&tc->napi);
+		netif_napi_del(&tc->napi);
+		__skb_queue_purge(&tc->queue);
+	}
+
+	free_netdev(napi_dev);
+}
+
+static int trelay_napi_init(void)
+{
+	int cpu;
+
+	napi_dev = alloc_netdev_dummy(0);
+	if (!napi_dev)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct trelay_cpu *tc = per_cpu_ptr(&trelay_cpu, cpu);
+
+		__skb_queue_head_init(&tc->queue);
+		netif_napi_add(napi_dev, &tc->napi, trelay_poll);
+		napi_enable(&tc->napi);
+	}
+
+	return 0;
+}
+
 static int __init trelay_init(void)
 {
 	int ret;
 
-	debugfs_dir = debugfs_create_dir("trelay", NULL);
-	if (!debugfs_dir)
+	trelay_wq = alloc_workqueue("trelay", 0, 0);
+	if (!trelay_wq)
 		return -ENOMEM;
 
+	ret = trelay_napi_init();
+	if (ret)
+		goto error_wq;
+
+	debugfs_dir = debugfs_create_dir("trelay", NULL);
+	if (!debugfs_dir) {
+		ret = -ENOMEM;
+		goto error_napi;
+	}
+
 	debugfs_create_file("add", S_IWUSR, debugfs_dir, NULL, &fops_add);
 
 	ret = register_netdevice_notifier(&tr_dev_notifier);
@@ -272,6 +663,10 @@ static int __init trelay_init(void)
 
 error:
 	debugfs_remove_recursive(debugfs_dir);
+error_napi:
+	trelay_napi_cleanup();
+error_wq:
+	destroy_workqueue(trelay_wq);
 	return ret;
 }
 
@@ -286,7 +681,12 @@ static void __exit trelay_exit(void)
 		trelay_do_remove(tr);
 	rtnl_unlock();
 
+	/* wait for the pending frees, they need the NAPI polls to run */
+	rcu_barrier();
+	destroy_workqueue(trelay_wq);
+
 	debugfs_remove_recursive(debugfs_dir);
+	trelay_napi_cleanup();
 }
 
 module_init(trelay_init);
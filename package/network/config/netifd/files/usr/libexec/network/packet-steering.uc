@@ -1,6 +1,8 @@
 #!/usr/bin/env ucode
 'use strict';
 import { glob, basename, dirname, readlink, readfile, realpath, writefile, error, open } from "fs";
+import * as libubus from "ubus";
+import * as uloop from "uloop";
 
 let napi_weight = 1.0;
 let cpu_thread_weight = 0.75;
@@ -11,6 +13,15 @@ let disable;
 let cpus;
 let all_cpus;
 let local_flows = 0;
+let root = "";
+let interval = 0;
+let threshold = 10;
+let hold_intervals = 3;
+let test_rounds = 0;
+let trace = [];
+let trace_len = 64;
+let round = 0;
+let tasks = {};
 
 while (length(ARGV) > 0) {
 	let arg = shift(ARGV);
@@ -30,12 +41,45 @@ while (length(ARGV) > 0) {
 	case '-l':
 		local_flows = +shift(ARGV);
 		break;
+	case '-a':
+		interval = +shift(ARGV);
+		break;
+	case '-H':
+		threshold = +shift(ARGV);
+		break;
+	case '-R':
+		root = shift(ARGV);
+		break;
+	case '-T':
+		test_rounds = +shift(ARGV);
+		break;
+	}
+}
+
+/*
+ * With -R, all sysfs/procfs accesses are done relative to a fake root.
+ * The pids found there do not exist, so taskset is never run.
+ * In test mode (-T <rounds>), procfs samples for round N are taken from
+ * <root>/proc.N if present, so a fixture can provide a load sequence.
+ */
+function sys_path(path)
+{
+	return root + path;
+}
+
+function proc_path(path)
+{
+	if (test_rounds) {
+		let dir = `${root}/proc.${round}`;
+		if (length(glob(dir)) > 0)
+			return dir + substr(path, 5);
 	}
+	return root + path;
 }
 
 function task_name(pid)
 {
-	let stat = open(`/proc/${pid}/status`, "r");
+	let stat = open(proc_path(`/proc/${pid}/status`), "r");
 	if (!stat)
 		return;
 	let line = stat.read("line");
@@ -51,8 +95,17 @@ function set_task_cpu(pid, cpu) {
 		return;
 	if (debug || do_nothing)
 		warn(`taskset -p -c ${cpu} ${name}\n`);
-	if (!do_nothing)
+	if (!do_nothing && !root)
 		system(`taskset -p -c ${cpu} ${pid}`);
+
+	let prev = tasks[pid];
+	tasks[pid] = {
+		pid, name,
+		cpu: (!disable && cpu >= 0) ? int(cpu) : null,
+		runtime: prev?.runtime,
+		load: prev?.load ?? 0.0,
+		moved: prev?.moved ?? -hold_intervals,
+	};
 }
 
 function cpu_mask(cpu)
@@ -67,7 +120,7 @@ function cpu_mask(cpu)
 
 function set_netdev_cpu(dev, cpu, rx_queue) {
 	rx_queue ??= "rx-*";
-	let queues = glob(`/sys/class/net/${dev}/queues/${rx_queue}/rps_cpus`);
+	let queues = glob(sys_path(`/sys/class/net/${dev}/queues/${rx_queue}/rps_cpus`));
 	let val = cpu_mask(cpu);
 	if (disable)
 		val = 0;
@@ -77,7 +130,7 @@ function set_netdev_cpu(dev, cpu, rx_queue) {
 		if (!do_nothing)
 			writefile(queue, `${val}`);
 	}
-	queues = glob(`/sys/class/net/${dev}/queues/${rx_queue}/rps_flow_cnt`);
+	queues = glob(sys_path(`/sys/class/net/${dev}/queues/${rx_queue}/rps_flow_cnt`));
 	for (let queue in queues) {
 		if (debug || do_nothing)
 			warn(`echo ${local_flows} > ${queue}\n`);
@@ -102,11 +155,13 @@ function task_device_match(name, device)
 	return false;
 }
 
-cpus = map(glob("/sys/bus/cpu/devices/*"), (path) => {
+cpus = map(glob(sys_path("/sys/bus/cpu/devices/*")), (path) => {
 	return {
 		id: int(match(path, /.*cpu(\d+)/)[1]),
 		core: int(trim(readfile(`${path}/topology/core_id`))),
 		load: 0.0,
+		softirq: null,
+		busy: 0.0,
 	};
 });
 
@@ -140,63 +195,76 @@ function get_next_cpu(weight, prev_cpu)
 	cpu_add_weight(cpu, weight);
 	return cpu;
 }
+let phys_devs;
 
-let phys_devs = {};
-let netdev_phys = {};
-let netdevs = map(glob("/sys/class/net/*"), (dev) => basename(dev));
-
-for (let dev in netdevs) {
-	let pdev_path = realpath(`/sys/class/net/${dev}/device`);
-	if (!pdev_path)
-		continue;
-
-	if (length(glob(`/sys/class/net/${dev}/lower_*`)) > 0)
-		continue;
-
-	let pdev = phys_devs[pdev_path];
-	if (!pdev) {
-		pdev = phys_devs[pdev_path] = {
-			path: pdev_path,
-			driver: basename(readlink(`${pdev_path}/driver`)),
-			netdev: [],
-			phy: [],
-			tasks: [],
-			rx_tasks: [],
-			rx_queues: map(glob(`/sys/class/net/${dev}/queues/rx-*/rps_cpus`),
-			               (v) => basename(dirname(v))),
-		};
-	}
+function scan_devices()
+{
+	let devs = {};
 
-	let phyidx = trim(readfile(`/sys/class/net/${dev}/phy80211/index`));
-	if (phyidx != null) {
-		let phy = `phy${phyidx}`;
-		if (index(pdev.phy, phy) < 0)
-			push(pdev.phy, phy);
-	}
+	let netdevs = map(glob(sys_path("/sys/class/net/*")), (dev) => basename(dev));
+	for (let dev in netdevs) {
+		let pdev_path = realpath(sys_path(`/sys/class/net/${dev}/device`));
+		if (!pdev_path)
+			continue;
 
-	push(pdev.netdev, dev);
-	netdev_phys[dev] = pdev;
-}
+		if (length(glob(sys_path(`/sys/class/net/${dev}/lower_*`))) > 0)
+			continue;
 
-for (let path in glob("/proc/*/exe")) {
-	readlink(path);
-	if (error() != "No such file or directory")
-		continue;
+		let pdev = devs[pdev_path];
+		if (!pdev) {
+			pdev = devs[pdev_path] = {
+				path: pdev_path,
+				driver: basename(readlink(`${pdev_path}/driver`)),
+				netdev: [],
+				phy: [],
+				tasks: [],
+				rx_tasks: [],
+				rx_queues: map(glob(sys_path(`/sys/class/net/${dev}/queues/rx-*/rps_cpus`)),
+				               (v) => basename(dirname(v))),
+			};
+		}
+
+		let phyidx = trim(readfile(sys_path(`/sys/class/net/${dev}/phy80211/index`)));
+		if (phyidx != null) {
+			let phy = `phy${phyidx}`;
+			if (index(pdev.phy, phy) < 0)
+				push(pdev.phy, phy);
+		}
+
+		push(pdev.netdev, dev);
+	}
 
-	let pid = basename(dirname(path));
-	let name = task_name(pid);
-	for (let devname in phys_devs) {
-		let dev = phys_devs[devname];
-		if (!task_device_match(name, dev))
+	for (let path in glob(proc_path("/proc/[0-9]*/status"))) {
+		let pid = basename(dirname(path));
+
+		// kernel threads have no exe link target
+		readlink(proc_path(`/proc/${pid}/exe`));
+		if (error() != "No such file or directory")
 			continue;
 
-		push(dev.tasks, pid);
+		let name = task_name(pid);
+		for (let devname in devs) {
+			let dev = devs[devname];
+			if (!task_device_match(name, dev))
+				continue;
 
-		let napi_match = match(name, /napi\/([^-]*)-(\d+)/);
-		if (napi_match && napi_match[2] > 0)
-			push(dev.rx_tasks, pid);
-		break;
+			push(dev.tasks, pid);
+
+			let napi_match = match(name, /napi\/([^-]*)-(\d+)/);
+			if (napi_match && napi_match[2] > 0)
+				push(dev.rx_tasks, pid);
+			break;
+		}
 	}
+
+	return devs;
+}
+
+// netdevs and NAPI threads that steering applies to
+function devices_key(devs)
+{
+	return join(" ", sort(map(values(devs), (dev) =>
+		`${dev.path}=${join(",", dev.netdev)}/${join(",", dev.tasks)}`)));
 }
 
 function assign_dev_queues_cpu(dev) {
@@ -247,33 +315,257 @@ function assign_dev_cpu(dev) {
 		if (all_cpus)
 			cpu = -1;
 		else
-			cpu = get_next_cpu(rx_weight, dev.napi_cpu);
+			cpu = dev.rps_cpu = get_next_cpu(rx_weight, dev.napi_cpu);
 		for (let netdev in dev.netdev)
 			set_netdev_cpu(netdev, cpu);
 	}
 }
 
-// Assign ethernet devices first
-for (let devname in phys_devs) {
-	let dev = phys_devs[devname];
-	if (!length(dev.phy))
-		assign_dev_cpu(dev);
+function steer()
+{
+	for (let cpu in cpus)
+		cpu.load = 0.0;
+	tasks = {};
+
+	phys_devs = scan_devices();
+
+	// Assign ethernet devices first
+	for (let devname in phys_devs) {
+		let dev = phys_devs[devname];
+		if (!length(dev.phy))
+			assign_dev_cpu(dev);
+	}
+
+	// Add bias to avoid assigning other tasks to CPUs with ethernet NAPI
+	for (let devname in phys_devs) {
+		let dev = phys_devs[devname];
+		if (!length(dev.tasks) || dev.napi_cpu == null)
+			continue;
+		cpu_add_weight(dev.napi_cpu, eth_bias);
+	}
+
+	// Assign WLAN devices
+	for (let devname in phys_devs) {
+		let dev = phys_devs[devname];
+		if (length(dev.phy) > 0)
+			assign_dev_cpu(dev);
+	}
+
+	if (debug > 1)
+		warn(sprintf("devices: %.J\ncpus: %.J\n", phys_devs, cpus));
+}
+
+steer();
+
+if (test_rounds && !interval)
+	interval = 1;
+
+if (!interval || disable)
+	exit(0);
+
+/*
+ * Adaptive mode: sample per-CPU softirq time from /proc/stat and the
+ * runtime of every steered NAPI thread from /proc/<pid>/stat, then move
+ * at most one thread per interval from the busiest to the least loaded
+ * CPU. Loads are in percent of one CPU.
+ */
+function trace_add(entry)
+{
+	entry.round = round;
+	push(trace, entry);
+	if (length(trace) > trace_len)
+		shift(trace);
+	if (debug)
+		warn(sprintf("%J\n", entry));
+}
+
+function sample_cpus(ticks)
+{
+	let stat = open(proc_path("/proc/stat"), "r");
+	if (!stat)
+		return;
+
+	let line;
+	while ((line = stat.read("line")) != null && length(line) > 0) {
+		let fields = split(trim(line), /\s+/);
+		let id = match(fields[0], /^cpu(\d+)$/);
+		if (!id)
+			continue;
+
+		let cpu = cpus[int(id[1])];
+		if (!cpu)
+			continue;
+
+		let softirq = int(fields[7]);
+		if (cpu.softirq != null && ticks > 0)
+			cpu.busy = (softirq - cpu.softirq) * 100.0 / ticks;
+		cpu.softirq = softirq;
+	}
+	stat.close();
+}
+
+function sample_tasks(ticks)
+{
+	for (let pid, task in tasks) {
+		let stat = readfile(proc_path(`/proc/${pid}/stat`));
+		if (!stat)
+			continue;
+
+		// skip past the comm field, which may contain spaces
+		let fields = split(trim(substr(stat, rindex(stat, ")") + 2)), " ");
+		let runtime = int(fields[11]) + int(fields[12]);
+		if (task.runtime != null && ticks > 0)
+			task.load = (runtime - task.runtime) * 100.0 / ticks;
+		task.runtime = runtime;
+	}
+}
+
+function cpu_loads()
+{
+	let loads = map(cpus, (cpu) => cpu.busy);
+	for (let pid, task in tasks)
+		if (task.cpu != null)
+			loads[task.cpu] += task.load;
+	return loads;
+}
+
+function move_task(task, dst, loads)
+{
+	let src = task.cpu;
+
+	trace_add({
+		action: "move", pid: task.pid, name: task.name,
+		from: src, to: dst, task_load: task.load, loads,
+	});
+
+	set_task_cpu(task.pid, dst);
+	tasks[task.pid].moved = round;
+
+	// keep RPS off the CPU that now runs the NAPI thread
+	for (let devname, dev in phys_devs) {
+		if (index(dev.tasks, task.pid) < 0 || dev.napi_cpu != src)
+			continue;
+
+		dev.napi_cpu = dst;
+		if (dev.rps_cpu != dst)
+			break;
+
+		let rps = null;
+		for (let i = 0; i < length(loads); i++)
+			if (i != dst && (rps == null || loads[i] < loads[rps]))
+				rps = i;
+
+		trace_add({
+			action: "rps", device: dev.netdev, from: dev.rps_cpu, to: rps,
+		});
+		dev.rps_cpu = rps;
+		for (let netdev in dev.netdev)
+			set_netdev_cpu(netdev, rps);
+		break;
+	}
+}
+
+function rebalance()
+{
+	let loads = cpu_loads();
+	let src = 0, dst = 0;
+
+	for (let i = 1; i < length(loads); i++) {
+		if (loads[i] > loads[src])
+			src = i;
+		if (loads[i] < loads[dst])
+			dst = i;
+	}
+
+	if (loads[src] - loads[dst] < threshold)
+		return;
+
+	// pick the thread whose move brings the pair closest to balance,
+	// and only if the busiest CPU improves by more than the threshold
+	let best, best_peak = loads[src] - threshold;
+	for (let pid, task in tasks) {
+		if (task.cpu != src || task.load <= 0)
+			continue;
+		if (round - task.moved < hold_intervals)
+			continue;
+
+		let peak = loads[src] - task.load;
+		if (loads[dst] + task.load > peak)
+			peak = loads[dst] + task.load;
+		if (peak < best_peak) {
+			best = task;
+			best_peak = peak;
+		}
+	}
+
+	if (best)
+		move_task(best, dst, loads);
+}
+
+function sample(ticks)
+{
+	sample_cpus(ticks);
+	sample_tasks(ticks);
+	if (round > 0)
+		rebalance();
+	round++;
+}
+
+function status()
+{
+	return {
+		interval, threshold, round,
+		cpus: map(cpus, (cpu) => ({ id: cpu.id, softirq_load: cpu.busy })),
+		tasks: values(tasks),
+		trace,
+	};
 }
 
-// Add bias to avoid assigning other tasks to CPUs with ethernet NAPI
-for (let devname in phys_devs) {
-	let dev = phys_devs[devname];
-	if (!length(dev.tasks) || dev.napi_cpu == null)
-		continue;
-	cpu_add_weight(dev.napi_cpu, eth_bias);
+// procfs time values are in USER_HZ (100) ticks
+let ticks = interval * 100;
+
+if (test_rounds) {
+	while (round < test_rounds)
+		sample(ticks);
+	printf("%.J\n", status());
+	exit(0);
 }
 
-// Assign WLAN devices
-for (let devname in phys_devs) {
-	let dev = phys_devs[devname];
-	if (length(dev.phy) > 0)
-		assign_dev_cpu(dev);
+uloop.init();
+let ubus = libubus.connect();
+if (!ubus) {
+	warn(`Failed to connect to ubus\n`);
+	exit(1);
 }
 
-if (debug > 1)
-	warn(sprintf("devices: %.J\ncpus: %.J\n", phys_devs, cpus));
+let obj = ubus.publish("packet_steering", {
+	status: {
+		args: {},
+		call: function(req) {
+			return status();
+		}
+	},
+	rescan: {
+		args: {},
+		call: function(req) {
+			// interface events do not always change the devices, keep
+			// the adaptive state if they did not
+			if (devices_key(scan_devices()) == devices_key(phys_devs))
+				return 0;
+
+			steer();
+			for (let cpu in cpus)
+				cpu.softirq = null;
+			trace_add({ action: "rescan" });
+			sample(0);
+			return 0;
+		}
+	},
+});
+
+sample(0);
+let timer = uloop.timer(interval * 1000, () => {
+	sample(ticks);
+	timer.set(interval * 1000);
+});
+uloop.run();
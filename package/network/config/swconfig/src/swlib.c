@@ -42,6 +42,10 @@ static struct genl_family *family;
 static struct nlattr *tb[SWITCH_ATTR_MAX + 1];
 static int refcount = 0;
 
+/* payload limit of a single batch request, larger batches are split */
+#define SWLIB_BATCH_MSG_SIZE	(32 * 1024)
+#define SWLIB_BATCH_MSG_HDR	256
+
 static struct nla_policy port_policy[SWITCH_ATTR_MAX] = {
 	[SWITCH_PORT_ID] = { .type = NLA_U32 },
 	[SWITCH_PORT_FLAG_TAGGED] = { .type = NLA_FLAG },
@@ -86,8 +90,8 @@ wait_handler(struct nl_msg *msg, void *arg)
 
 /* helper function for performing netlink requests */
 static int
-swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
-		int (*data)(struct nl_msg *, void *), void *arg)
+__swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
+		int (*data)(struct nl_msg *, void *), void *arg, size_t size)
 {
 	struct nl_msg *msg;
 	struct nl_cb *cb = NULL;
@@ -95,7 +99,10 @@ swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
 	int flags = 0;
 	int err = 0;
 
-	msg = nlmsg_alloc();
+	if (size)
+		msg = nlmsg_alloc_size(size);
+	else
+		msg = nlmsg_alloc();
 	if (!msg) {
 		fprintf(stderr, "Out of memory!\n");
 		exit(1);
@@ -149,6 +156,13 @@ nla_put_failure:
 	return err;
 }
 
+static inline int
+swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
+		int (*data)(struct nl_msg *, void *), void *arg)
+{
+	return __swlib_call(cmd, call, data, arg, 0);
+}
+
 static int
 send_attr(struct nl_msg *msg, void *arg)
 {
@@ -429,27 +443,29 @@ enum {
 	CMD_SPEED,
 };
 
-int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int port_vlan, const char *str)
+/* parse a string value for an attribute, returns 1 if nothing needs to be set */
+static int
+swlib_parse_val(struct switch_dev *dev, struct switch_attr *a, const char *str,
+		struct switch_val *val)
 {
 	struct switch_port *ports;
 	struct switch_port_link *link;
-	struct switch_val val;
-	char *ptr;
+	char *buf, *ptr;
 	int cmd = CMD_NONE;
 
-	memset(&val, 0, sizeof(val));
-	val.port_vlan = port_vlan;
 	switch(a->type) {
 	case SWITCH_TYPE_INT:
-		val.value.i = atoi(str);
+		val->value.i = atoi(str);
 		break;
 	case SWITCH_TYPE_STRING:
-		val.value.s = (char *)str;
+		val->value.s = (char *)str;
 		break;
 	case SWITCH_TYPE_PORTS:
-		ports = alloca(sizeof(struct switch_port) * dev->ports);
-		memset(ports, 0, sizeof(struct switch_port) * dev->ports);
-		val.len = 0;
+		ports = swlib_alloc(sizeof(struct switch_port) * dev->ports);
+		if (!ports)
+			return -1;
+		val->value.ports = ports;
+		val->len = 0;
 		ptr = (char *)str;
 		while(ptr && *ptr)
 		{
@@ -460,32 +476,35 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int por
 				break;
 
 			if (!isdigit(*ptr))
-				return -1;
+				goto error;
 
-			if (val.len >= dev->ports)
-				return -1;
+			if (val->len >= dev->ports)
+				goto error;
 
-			ports[val.len].flags = 0;
-			ports[val.len].id = strtoul(ptr, &ptr, 10);
+			ports[val->len].flags = 0;
+			ports[val->len].id = strtoul(ptr, &ptr, 10);
 			while(*ptr && !isspace(*ptr)) {
 				if (*ptr == 't')
-					ports[val.len].flags |= SWLIB_PORT_FLAG_TAGGED;
+					ports[val->len].flags |= SWLIB_PORT_FLAG_TAGGED;
 				else
-					return -1;
+					goto error;
 
 				ptr++;
 			}
 			if (*ptr)
 				ptr++;
-			val.len++;
+			val->len++;
 		}
-		val.value.ports = ports;
 		break;
 	case SWITCH_TYPE_LINK:
-		link = malloc(sizeof(struct switch_port_link));
-		memset(link, 0, sizeof(struct switch_port_link));
-		ptr = (char *)str;
-		for (ptr = strtok(ptr," "); ptr; ptr = strtok(NULL, " ")) {
+		link = swlib_alloc(sizeof(struct switch_port_link));
+		buf = strdup(str);
+		if (!link || !buf) {
+			free(link);
+			free(buf);
+			return -1;
+		}
+		for (ptr = strtok(buf, " "); ptr; ptr = strtok(NULL, " ")) {
 			switch (cmd) {
 			case CMD_NONE:
 				if (!strcmp(ptr, "duplex"))
@@ -521,19 +540,242 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int por
 				break;
 			}
 		}
-		val.value.link = link;
+		free(buf);
+		val->value.link = link;
 		break;
 	case SWITCH_TYPE_NOVAL:
 		if (str && !strcmp(str, "0"))
-			return 0;
+			return 1;
 
 		break;
 	default:
 		return -1;
 	}
-	return swlib_set_attr(dev, a, &val);
+
+	return 0;
+
+error:
+	free(val->value.ports);
+	val->value.ports = NULL;
+	return -1;
+}
+
+static void
+swlib_free_val(struct switch_attr *a, struct switch_val *val)
+{
+	switch(a->type) {
+	case SWITCH_TYPE_PORTS:
+		free(val->value.ports);
+		break;
+	case SWITCH_TYPE_LINK:
+		free(val->value.link);
+		break;
+	default:
+		break;
+	}
+}
+
+int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int port_vlan, const char *str)
+{
+	struct switch_val val;
+	int ret;
+
+	memset(&val, 0, sizeof(val));
+	val.port_vlan = port_vlan;
+	ret = swlib_parse_val(dev, a, str, &val);
+	if (ret)
+		return ret < 0 ? ret : 0;
+
+	ret = swlib_set_attr(dev, a, &val);
+	swlib_free_val(a, &val);
+
+	return ret;
 }
 
+struct swlib_batch_entry {
+	struct switch_val val;
+	struct swlib_batch_entry *next;
+};
+
+struct swlib_batch {
+	struct switch_dev *dev;
+	struct swlib_batch_entry *entries;
+	struct swlib_batch_entry **tail;
+};
+
+struct swlib_batch_chunk {
+	struct switch_dev *dev;
+	struct swlib_batch_entry *start;
+	struct swlib_batch_entry *end;
+};
+
+/* upper bound of the netlink payload of a single batch entry */
+static size_t
+swlib_batch_entry_size(struct switch_val *val)
+{
+	size_t len = nla_total_size(0) + 3 * nla_total_size(sizeof(uint32_t));
+
+	switch(val->attr->type) {
+	case SWITCH_TYPE_INT:
+		len += nla_total_size(sizeof(uint32_t));
+		break;
+	case SWITCH_TYPE_STRING:
+		len += nla_total_size(strlen(val->value.s) + 1);
+		break;
+	case SWITCH_TYPE_PORTS:
+		len += nla_total_size(0) + val->len *
+			(nla_total_size(0) + nla_total_size(sizeof(uint32_t)) +
+			 nla_total_size(0));
+		break;
+	case SWITCH_TYPE_LINK:
+		len += nla_total_size(0) + 2 * nla_total_size(0) +
+			nla_total_size(sizeof(uint32_t));
+		break;
+	default:
+		break;
+	}
+
+	return len;
+}
+
+static int
+swlib_batch_cmd(struct switch_attr *attr)
+{
+	switch(attr->atype) {
+	case SWLIB_ATTR_GROUP_GLOBAL:
+		return SWITCH_CMD_SET_GLOBAL;
+	case SWLIB_ATTR_GROUP_PORT:
+		return SWITCH_CMD_SET_PORT;
+	case SWLIB_ATTR_GROUP_VLAN:
+		return SWITCH_CMD_SET_VLAN;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int
+send_batch(struct nl_msg *msg, void *arg)
+{
+	struct swlib_batch_chunk *chunk = arg;
+	struct swlib_batch_entry *e;
+	struct nlattr *n, *op;
+
+	NLA_PUT_U32(msg, SWITCH_ATTR_ID, chunk->dev->id);
+	n = nla_nest_start(msg, SWITCH_ATTR_OP_BATCH);
+	if (!n)
+		goto nla_put_failure;
+
+	for (e = chunk->start; e != chunk->end; e = e->next) {
+		op = nla_nest_start(msg, swlib_batch_cmd(e->val.attr));
+		if (!op)
+			goto nla_put_failure;
+		if (send_attr_val(msg, &e->val))
+			goto nla_put_failure;
+		nla_nest_end(msg, op);
+	}
+	nla_nest_end(msg, n);
+
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+struct swlib_batch *
+swlib_batch_new(struct switch_dev *dev)
+{
+	struct swlib_batch *batch;
+
+	batch = swlib_alloc(sizeof(*batch));
+	if (!batch)
+		return NULL;
+
+	batch->dev = dev;
+	batch->tail = &batch->entries;
+
+	return batch;
+}
+
+int
+swlib_batch_add_string(struct swlib_batch *batch, struct switch_attr *attr,
+		int port_vlan, const char *str)
+{
+	struct swlib_batch_entry *e;
+	int ret;
+
+	if (swlib_batch_cmd(attr) < 0)
+		return -EINVAL;
+
+	e = swlib_alloc(sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+
+	e->val.attr = attr;
+	e->val.port_vlan = port_vlan;
+	ret = swlib_parse_val(batch->dev, attr, str, &e->val);
+	if (!ret && attr->type == SWITCH_TYPE_STRING) {
+		e->val.value.s = strdup(str);
+		if (!e->val.value.s)
+			ret = -ENOMEM;
+	}
+	if (ret) {
+		free(e);
+		return ret < 0 ? ret : 0;
+	}
+
+	*batch->tail = e;
+	batch->tail = &e->next;
+
+	return 0;
+}
+
+int
+swlib_batch_commit(struct swlib_batch *batch)
+{
+	struct swlib_batch_chunk chunk = {
+		.dev = batch->dev,
+		.start = batch->entries,
+	};
+	size_t len;
+	int err;
+
+	while (chunk.start) {
+		len = 0;
+		for (chunk.end = chunk.start; chunk.end; chunk.end = chunk.end->next) {
+			len += swlib_batch_entry_size(&chunk.end->val);
+			if (len > SWLIB_BATCH_MSG_SIZE && chunk.end != chunk.start)
+				break;
+		}
+
+		err = __swlib_call(SWITCH_CMD_SET_BATCH, NULL, send_batch, &chunk,
+				   len + SWLIB_BATCH_MSG_HDR);
+		if (err == -NLE_OPNOTSUPP && chunk.start == batch->entries)
+			return -EOPNOTSUPP;
+		if (err)
+			return err;
+
+		chunk.start = chunk.end;
+	}
+
+	return 0;
+}
+
+void
+swlib_batch_free(struct swlib_batch *batch)
+{
+	struct swlib_batch_entry *e;
+
+	while (batch->entries) {
+		e = batch->entries;
+		batch->entries = e->next;
+		if (e->val.attr->type == SWITCH_TYPE_STRING)
+			free(e->val.value.s);
+		else
+			swlib_free_val(e->val.attr, &e->val);
+		free(e);
+	}
+	free(batch);
+}
 
 struct attrlist_arg {
 	int id;
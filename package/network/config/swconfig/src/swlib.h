@@ -116,6 +116,7 @@ struct switch_port;
 struct switch_port_map;
 struct switch_port_link;
 struct switch_val;
+struct swlib_batch;
 struct uci_package;
 
 struct switch_dev {
@@ -248,6 +249,42 @@ int swlib_set_attr(struct switch_dev *dev, struct switch_attr *attr,
 int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *attr,
 		int port_vlan, const char *str);
 
+/**
+ * swlib_batch_new: start a batch of attribute changes
+ * @dev: switch device struct
+ *
+ * the changes added to the batch are sent to the kernel with
+ * swlib_batch_commit() and applied there under a single lock
+ */
+struct swlib_batch *swlib_batch_new(struct switch_dev *dev);
+
+/**
+ * swlib_batch_add_string: queue an attribute change with type conversion
+ * @batch: batch struct
+ * @attr: switch attribute struct
+ * @port_vlan: port or vlan (if applicable)
+ * @str: string value
+ * returns 0 on success, a negative value if the string cannot be parsed
+ * or on allocation failure (nothing is queued in that case)
+ */
+int swlib_batch_add_string(struct swlib_batch *batch, struct switch_attr *attr,
+		int port_vlan, const char *str);
+
+/**
+ * swlib_batch_commit: send all queued attribute changes
+ * @batch: batch struct
+ * returns 0 on success, -EOPNOTSUPP if the kernel does not support
+ * batched requests (nothing has been changed in that case). On other
+ * errors the changes queued before the failing one may have been applied.
+ */
+int swlib_batch_commit(struct swlib_batch *batch);
+
+/**
+ * swlib_batch_free: free a batch and all queued changes
+ * @batch: batch struct
+ */
+void swlib_batch_free(struct swlib_batch *batch);
+
 /**
  * swlib_get_attr: get the value for an attribute
  * @dev: switch device struct
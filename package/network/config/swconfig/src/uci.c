@@ -105,8 +105,41 @@ skip:
 	}
 }
 
+static int
+swlib_apply_batch(struct switch_dev *dev, struct switch_attr *apply)
+{
+	struct swlib_batch *batch;
+	struct swlib_setting *st;
+	int i, ret = 0;
+
+	batch = swlib_batch_new(dev);
+	if (!batch)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(early_settings) && !ret; i++) {
+		st = &early_settings[i];
+		if (!st->attr || !st->val)
+			continue;
+		ret = swlib_batch_add_string(batch, st->attr, st->port_vlan, st->val);
+	}
+
+	for (st = settings; st && !ret; st = st->next)
+		ret = swlib_batch_add_string(batch, st->attr, st->port_vlan, st->val);
+
+	if (apply && !ret)
+		ret = swlib_batch_add_string(batch, apply, 0, "1");
+
+	/* nothing has been sent yet if building the batch failed */
+	if (!ret)
+		ret = swlib_batch_commit(batch);
+	swlib_batch_free(batch);
+
+	return ret;
+}
+
 int swlib_apply_from_uci(struct switch_dev *dev, struct uci_package *p)
 {
+	struct swlib_setting *st;
 	struct switch_attr *attr;
 	struct uci_element *e;
 	struct uci_section *s;
@@ -224,30 +257,41 @@ found:
 		swlib_map_settings(dev, SWLIB_ATTR_GROUP_PORT, port_n, s);
 	}
 
-	for (i = 0; i < ARRAY_SIZE(early_settings); i++) {
-		struct swlib_setting *st = &early_settings[i];
-		if (!st->attr || !st->val)
-			continue;
-		swlib_set_attr_string(dev, st->attr, st->port_vlan, st->val);
+	/* Apply the config */
+	attr = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_GLOBAL, "apply");
+
+	/* send everything in one request, so the switch is not left half
+	 * configured in between. The batch is not transactional: the kernel
+	 * stops at the first failing setting, but the ones before it (and
+	 * earlier requests of a split batch) have been applied already.
+	 * If the batch fails or is not supported, start over and set the
+	 * options one by one, skipping invalid ones. The early settings
+	 * begin with a reset where the switch supports it, which discards
+	 * the partially applied batch, and every setting is sent again, so
+	 * the switch ends up in the same state as without batching. */
+	if (swlib_apply_batch(dev, attr)) {
+		for (i = 0; i < ARRAY_SIZE(early_settings); i++) {
+			struct swlib_setting *st = &early_settings[i];
+			if (!st->attr || !st->val)
+				continue;
+			swlib_set_attr_string(dev, st->attr, st->port_vlan, st->val);
+
+		}
 
+		for (st = settings; st; st = st->next)
+			swlib_set_attr_string(dev, st->attr, st->port_vlan, st->val);
+
+		if (attr) {
+			memset(&val, 0, sizeof(val));
+			swlib_set_attr(dev, attr, &val);
+		}
 	}
 
 	while (settings) {
-		struct swlib_setting *st = settings;
-
-		swlib_set_attr_string(dev, st->attr, st->port_vlan, st->val);
-		st = st->next;
+		st = settings->next;
 		free(settings);
 		settings = st;
 	}
 
-	/* Apply the config */
-	attr = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_GLOBAL, "apply");
-	if (!attr)
-		return 0;
-
-	memset(&val, 0, sizeof(val));
-	swlib_set_attr(dev, attr, &val);
-
 	return 0;
 }
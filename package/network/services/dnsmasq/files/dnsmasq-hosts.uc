@@ -0,0 +1,184 @@
+#!/usr/bin/ucode
+// Generate the static host configuration of a dnsmasq instance from the
+// host and domain sections of /etc/config/dhcp in a single pass, instead
+// of walking them with config_foreach in the init script.
+//
+// usage: dnsmasq-hosts.uc <instance> <dhcp version> <dhcp options> <domain>
+//                         <config file> <dhcp hosts file> <hosts file>
+//
+// DHCP options of hosts are appended to the config file, dhcp-host entries
+// to the dhcp hosts file and DNS records to the hosts file, in the same
+// format as dhcp_host_add and dhcp_domain_add in /etc/init.d/dnsmasq.
+// DHCP options are only written if <dhcp options> is 1, i.e. if
+// dnsmasq_ignore_opt in the init script keeps them for this dnsmasq build.
+
+'use strict';
+
+import { cursor } from 'uci';
+import { open } from 'fs';
+
+const [ instance, dhcp_ver, dhcp_opts, domain, conffile, dhcphostsfile, hostsfile ] = ARGV;
+
+function words(str) {
+	return filter(split(str, /[ \t\n]+/), length);
+}
+
+function get(s, opt) {
+	let val = s[opt];
+
+	if (type(val) == 'array')
+		return join(' ', val);
+
+	return val ?? '';
+}
+
+function get_list(s, opt) {
+	return type(s[opt]) == 'array' ? s[opt] : [];
+}
+
+function get_bool(s, opt, def) {
+	switch (get(s, opt)) {
+	case '1':
+	case 'on':
+	case 'true':
+	case 'yes':
+	case 'enabled':
+		return true;
+
+	case '0':
+	case 'off':
+	case 'false':
+	case 'no':
+	case 'disabled':
+		return false;
+
+	default:
+		return def;
+	}
+}
+
+function hex_to_hostid(str) {
+	let digits = replace(str, /^0x/, '');
+
+	if (!match(digits, /^[0-9a-fA-F]+$/))
+		return str;
+
+	let val = hex(digits);
+
+	return sprintf('%x:%x', (val >> 16) % 65536, val % 65536);
+}
+
+function open_append(path) {
+	let fd = open(path, 'a');
+
+	if (!fd) {
+		warn(`dnsmasq: unable to open ${path}\n`);
+		exit(1);
+	}
+
+	return fd;
+}
+
+let conf = open_append(conffile);
+let dhcphosts = open_append(dhcphostsfile);
+let hosts = open_append(hostsfile);
+
+function dhcp_option_add(s, networkid, force) {
+	let options = s.dhcp_option;
+
+	if (type(options) == 'string') {
+		if (length(options))
+			warn("Warning: the 'option dhcp_option' syntax is deprecated, use 'list dhcp_option'\n");
+		options = words(options);
+	}
+
+	if (dhcp_opts != '1')
+		return;
+
+	for (let option in options ?? [])
+		conf.write(`dhcp-option${force ? '-force' : ''}=${networkid},${option}\n`);
+}
+
+function dhcp_host_add(s) {
+	let force = get_bool(s, 'force', false);
+	let networkid = get(s, 'networkid');
+
+	if (networkid)
+		dhcp_option_add(s, networkid, force);
+
+	if (!get_bool(s, 'enable', true))
+		return;
+
+	let name = get(s, 'name');
+	let ip = get(s, 'ip');
+	let hostid = get(s, 'hostid');
+
+	if (!ip && !name && !hostid)
+		return;
+
+	if (get_bool(s, 'dns', false) && ip && name)
+		hosts.write(`${ip} ${name}${domain ? '.' + domain : ''}\n`);
+
+	let duid = get(s, 'duid');
+	let mtags = join('', map(get_list(s, 'match_tag'), (t) => `tag:${t},`));
+	let macs = join(',', words(get(s, 'mac')));
+	let duids = (dhcp_ver == '6' && duid) ? 'id:' + split(duid, ' ')[0] : '';
+
+	if (!macs && !duids) {
+		if (!name)
+			return;
+
+		macs = name;
+		name = '';
+	}
+
+	if (hostid)
+		hostid = hex_to_hostid(hostid);
+
+	let tags = join(',set:', words(get(s, 'tag')));
+	let leasetime = get(s, 'leasetime');
+
+	let hosttag = (networkid ? ',set:' + networkid : '') +
+		(tags ? ',set:' + tags : '') +
+		(get_bool(s, 'broadcast', false) ? ',set:needs-broadcast' : '');
+	let nametime = (name ? ',' + name : '') + (leasetime ? ',' + leasetime : '');
+
+	if (dhcp_ver == '6')
+		dhcphosts.write(mtags + macs + (duids ? ',' + duids : '') + hosttag +
+			(ip ? ',' + ip : '') + (hostid ? ',[::' + hostid + ']' : '') +
+			nametime + '\n');
+	else
+		dhcphosts.write(mtags + macs + hosttag + (ip ? ',' + ip : '') +
+			nametime + '\n');
+}
+
+function dhcp_domain_add(s) {
+	let names = join(' ', words(get(s, 'name')));
+	let ip = get(s, 'ip');
+
+	if (names && ip)
+		hosts.write(`${ip} ${names}\n`);
+}
+
+let uci = cursor(getenv('UCI_CONFIG_DIR'));
+uci.load('dhcp');
+
+function filter_dnsmasq(s) {
+	let found = get(s, 'instance');
+
+	return !found || found == instance;
+}
+
+uci.foreach('dhcp', 'host', (s) => {
+	if (filter_dnsmasq(s))
+		dhcp_host_add(s);
+});
+
+uci.foreach('dhcp', 'domain', (s) => {
+	if (filter_dnsmasq(s))
+		dhcp_domain_add(s);
+});
+
+conf.close();
+dhcphosts.close();
+hosts.close();
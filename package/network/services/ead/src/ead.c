@@ -56,6 +56,7 @@
 
 #define PCAP_MRU		1600
 #define PCAP_TIMEOUT	200
+#define PCAP_RX_FRAMES	32	/* receive ring size, absorbs bursts of broadcasts */
 
 #if EAD_DEBUGLEVEL >= 1
 #define DEBUG(n, format, ...) do { \
@@ -146,7 +147,7 @@ ead_open_pcap(const char *ifname, char *errbuf, bool rx)
 	pcap_set_promisc(p, rx);
 	pcap_set_timeout(p, PCAP_TIMEOUT);
 	pcap_set_protocol_linux(p, (rx ? htons(ETH_P_IP) : 0));
-	pcap_set_buffer_size(p, (rx ? 10 : 1) * PCAP_MRU);
+	pcap_set_buffer_size(p, (rx ? PCAP_RX_FRAMES : 1) * PCAP_MRU);
 	pcap_activate(p);
 	set_recv_type(p, rx);
 out:
@@ -717,7 +718,12 @@ static void
 ead_pktloop(void)
 {
 	while (1) {
-		if (pcap_dispatch(pcap_fp_rx, 1, handle_packet, NULL) < 0) {
+		/*
+		 * Handle everything that is pending in the receive ring per
+		 * wakeup. Non-ead traffic is already dropped by the kernel
+		 * filter installed in ead_pcap_reopen().
+		 */
+		if (pcap_dispatch(pcap_fp_rx, -1, handle_packet, NULL) < 0) {
 			ead_pcap_reopen(false);
 			continue;
 		}
@@ -1,5 +1,5 @@
 let libubus = require("ubus");
-import { open, readfile, access } from "fs";
+import { open, readfile, access, stat } from "fs";
 import { wdev_remove, is_equal, vlist_new, phy_is_fullmac, phy_open, wdev_set_radio_mask, wdev_set_up } from "common";
 
 let ubus = libubus.connect(null, 60);
@@ -62,6 +62,14 @@ hostapd.data.bss_info_fields = {
 hostapd.data.mld = {};
 hostapd.data.dpp_hooks = {};
 
+// parsed BSS sections by config text and hashes of referenced files,
+// reused across reloads
+hostapd.data.bss_cache = {};
+hostapd.data.bss_cache_size = 0;
+hostapd.data.file_hash = {};
+
+const BSS_CACHE_MAX = 256;
+
 function iface_remove(cfg)
 {
 	if (!cfg || !cfg.bss || !cfg.bss[0] || !cfg.bss[0].ifname)
@@ -442,13 +450,36 @@ function remove_file_fields(config)
 	);
 }
 
+function bss_config_parse(config)
+{
+	let key = join("\n", config);
+	let cache = hostapd.data.bss_cache[key];
+	if (cache)
+		return cache;
+
+	if (hostapd.data.bss_cache_size >= BSS_CACHE_MAX) {
+		hostapd.data.bss_cache = {};
+		hostapd.data.bss_cache_size = 0;
+	}
+
+	cache = {
+		data: remove_file_fields(config),
+		ifaces: map(filter(config, (line) => !!hostapd.data.iface_fields[split(line, "=")[0]]),
+			    (line) => split(line, "=")[1]),
+	};
+	hostapd.data.bss_cache[key] = cache;
+	hostapd.data.bss_cache_size++;
+
+	return cache;
+}
+
 function bss_remove_file_fields(config)
 {
 	let new_cfg = {};
 
 	for (let key in config)
 		new_cfg[key] = config[key];
-	new_cfg.data = remove_file_fields(new_cfg.data);
+	new_cfg.data = bss_config_parse(new_cfg.data).data;
 	new_cfg.hash = {};
 	for (let key in config.hash)
 		new_cfg.hash[key] = config.hash[key];
@@ -459,13 +490,11 @@ function bss_remove_file_fields(config)
 	return new_cfg;
 }
 
-function bss_ifindex_list(config)
+function bss_ifindex_list(ifaces)
 {
-	config = filter(config, (line) => !!hostapd.data.iface_fields[split(line, "=")[0]]);
-
-	return join(",", map(config, (line) => {
+	return join(",", map(ifaces, (ifname) => {
 		try {
-			let file = "/sys/class/net/" + split(line, "=")[1] + "/ifindex";
+			let file = "/sys/class/net/" + ifname + "/ifindex";
 			let val = trim(readfile(file));
 			return val;
 		} catch (e) {
@@ -476,7 +505,9 @@ function bss_ifindex_list(config)
 
 function bss_config_hash(config)
 {
-	return hostapd.sha1(remove_file_fields(config) + bss_ifindex_list(config));
+	let parsed = bss_config_parse(config);
+
+	return hostapd.sha1(parsed.data + bss_ifindex_list(parsed.ifaces));
 }
 
 function bss_find_existing(config, prev_config, prev_hash)
@@ -555,10 +586,8 @@ function iface_reload_config(name, phydev, config, old_config)
 	let bss_list_cfg = [];
 	let prev_bss_hash = [];
 
-	for (let bss in old_config.bss) {
-		let hash = bss_config_hash(bss.data);
+	for (let bss in old_config.bss)
 		push(prev_bss_hash, bss_config_hash(bss.data));
-	}
 
 	// Step 1: find (possibly renamed) interfaces with the same config
 	// and store them in the new order (with gaps)
@@ -877,6 +906,31 @@ function iface_set_config(name, config)
 	return ret;
 }
 
+// Hash of a file referenced by the config. The cached value is keyed on
+// inode, mtime and size and only stored once the mtime is in the past, so
+// that a rewrite within the same second is not missed.
+function config_file_hash(field, file)
+{
+	let st = stat(file);
+	let id = st ? `${field} ${st.inode} ${st.mtime} ${st.size}` : null;
+	let cache = hostapd.data.file_hash[file];
+	if (id && cache && cache.id == id)
+		return cache.hash;
+
+	let hash;
+	if (field == "rxkh_file")
+		hash = hostapd.sha1(normalize_rxkhs(readfile(file)));
+	else
+		hash = hostapd.sha1(readfile(file));
+
+	if (id && st.mtime < time() - 1)
+		hostapd.data.file_hash[file] = { id, hash };
+	else
+		delete hostapd.data.file_hash[file];
+
+	return hash;
+}
+
 function config_add_bss(config, name)
 {
 	let bss = {
@@ -962,13 +1016,8 @@ function iface_load_config(phy, radio, filename)
 			continue;
 		}
 
-		if (hostapd.data.file_fields[val[0]]) {
-			if (val[0] == "rxkh_file") {
-				bss.hash[val[0]] = hostapd.sha1(normalize_rxkhs(readfile(val[1])));
-			} else {
-				bss.hash[val[0]] = hostapd.sha1(readfile(val[1]));
-			}
-		}
+		if (hostapd.data.file_fields[val[0]])
+			bss.hash[val[0]] = config_file_hash(val[0], val[1]);
 
 		push(bss.data, line);
 	}
@@ -0,0 +1,333 @@
+/*
+ * caldata - extract and patch wireless calibration data
+ *
+ * Copyright (C) 2026 OpenWrt.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Native replacement for the dd/hexdump pipelines in caldata.sh. The
+ * commands on the command line are executed in order on a buffer that
+ * holds the blob, so that it is read, patched and written in one process:
+ *
+ *   caldata extract /dev/mtd5 0x1000 0x844 patch 0x6 001122334455 0x2 \
+ *	write /lib/firmware/ath10k/cal-pci-0000:01:00.0.bin
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static uint8_t *buf;
+static size_t buf_len;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: caldata <command> [<args>] [<command> [<args>]...]\n"
+		"\n"
+		"Commands are executed in order on the current blob:\n"
+		"  extract <file> <offset> <count> read the blob from a file or device\n"
+		"  load <file>                     read the blob from a file\n"
+		"  reverse                         reverse the byte order of the blob\n"
+		"  patch <offset> <hex> [<csum>]   replace data at offset, update the\n"
+		"                                  16 bit XOR checksum at csum if given\n"
+		"  patch-if <offset> <old> <hex> [<csum>]\n"
+		"                                  patch only if the data at offset is <old>\n"
+		"  write <file>                    write the blob\n"
+		"\n"
+		"Offsets and counts are decimal or 0x prefixed hex, data is given as hex\n"
+		"digits without separators.\n");
+	exit(1);
+}
+
+static int parse_num(const char *str, size_t *val)
+{
+	unsigned long long v;
+	char *end;
+
+	errno = 0;
+	v = strtoull(str, &end, 0);
+	if (errno || !*str || *end || v > SIZE_MAX) {
+		fprintf(stderr, "caldata: invalid number '%s'\n", str);
+		return -1;
+	}
+
+	*val = v;
+	return 0;
+}
+
+static int hex_val(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	return -1;
+}
+
+static int parse_hex(const char *str, uint8_t **data, size_t *len)
+{
+	size_t i, n = strlen(str);
+
+	if (!n || n % 2)
+		goto invalid;
+
+	*len = n / 2;
+	*data = malloc(*len);
+	if (!*data)
+		return -1;
+
+	for (i = 0; i < *len; i++) {
+		int hi = hex_val(str[2 * i]);
+		int lo = hex_val(str[2 * i + 1]);
+
+		if (hi < 0 || lo < 0) {
+			free(*data);
+			goto invalid;
+		}
+
+		(*data)[i] = hi << 4 | lo;
+	}
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "caldata: invalid hex data '%s'\n", str);
+	return -1;
+}
+
+static int resize(size_t len)
+{
+	uint8_t *n = realloc(buf, len ? len : 1);
+
+	if (!n) {
+		fprintf(stderr, "caldata: out of memory\n");
+		return -1;
+	}
+
+	buf = n;
+	buf_len = len;
+	return 0;
+}
+
+/* short reads at the end of the source are accepted, like dd does */
+static int read_fd(int fd, off_t offset, size_t count, const char *name)
+{
+	size_t len = 0;
+
+	if (resize(count))
+		return -1;
+
+	while (len < count) {
+		ssize_t r = pread(fd, buf + len, count - len, offset + len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
+			fprintf(stderr, "caldata: failed to read %s: %s\n", name,
+				strerror(errno));
+			return -1;
+		}
+		if (!r)
+			break;
+
+		len += r;
+	}
+
+	buf_len = len;
+	return 0;
+}
+
+static int cmd_extract(const char *file, const char *offset_str,
+		       const char *count_str)
+{
+	size_t offset, count;
+	int fd, ret;
+
+	if (parse_num(offset_str, &offset) || parse_num(count_str, &count))
+		return -1;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "caldata: failed to open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	ret = read_fd(fd, offset, count, file);
+	close(fd);
+
+	return ret;
+}
+
+static int cmd_load(const char *file)
+{
+	struct stat st;
+	int fd, ret;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "caldata: failed to open %s: %s\n", file, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	ret = read_fd(fd, 0, st.st_size, file);
+	close(fd);
+
+	return ret;
+}
+
+static void cmd_reverse(void)
+{
+	size_t i;
+
+	for (i = 0; i < buf_len / 2; i++) {
+		uint8_t tmp = buf[i];
+
+		buf[i] = buf[buf_len - 1 - i];
+		buf[buf_len - 1 - i] = tmp;
+	}
+}
+
+static int cmd_patch(const char *offset_str, const char *old_str,
+		     const char *data_str, const char *csum_str)
+{
+	uint8_t *data = NULL, *old = NULL;
+	size_t offset, csum = 0, len, old_len, i;
+	int ret = -1;
+
+	if (parse_num(offset_str, &offset) ||
+	    (csum_str && parse_num(csum_str, &csum)) ||
+	    parse_hex(data_str, &data, &len) ||
+	    (old_str && parse_hex(old_str, &old, &old_len)))
+		goto out;
+
+	if (offset + len > buf_len || (csum_str && csum + 2 > buf_len)) {
+		fprintf(stderr, "caldata: patch outside of the blob\n");
+		goto out;
+	}
+
+	ret = 0;
+	if (old && (offset + old_len > buf_len || memcmp(buf + offset, old, old_len)))
+		goto out;
+
+	if (!memcmp(buf + offset, data, len))
+		goto out;
+
+	/*
+	 * The checksum is the XOR of all 16 bit words, update it with the
+	 * difference between the old and the new data. A trailing odd byte
+	 * counts as the low byte of a word, as in data_2xor_val.
+	 */
+	if (csum_str) {
+		for (i = 0; i < len; i++) {
+			size_t pos = (i % 2 || i == len - 1) ? 1 : 0;
+
+			buf[csum + pos] ^= buf[offset + i] ^ data[i];
+		}
+	}
+
+	memcpy(buf + offset, data, len);
+
+out:
+	free(data);
+	free(old);
+	return ret;
+}
+
+static int cmd_write(const char *file)
+{
+	size_t len = 0;
+	int fd;
+
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "caldata: failed to open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	while (len < buf_len) {
+		ssize_t r = write(fd, buf + len, buf_len - len);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			fprintf(stderr, "caldata: failed to write %s: %s\n", file,
+				strerror(errno));
+			close(fd);
+			return -1;
+		}
+
+		len += r;
+	}
+
+	if (close(fd)) {
+		fprintf(stderr, "caldata: failed to write %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int optional_arg(int argc, char **argv, int i)
+{
+	/* an optional checksum offset is numeric, commands are not */
+	return i < argc && isdigit((unsigned char)argv[i][0]);
+}
+
+int main(int argc, char **argv)
+{
+	int i = 1, ret = 0;
+
+	if (argc < 2)
+		usage();
+
+	while (i < argc && !ret) {
+		const char *cmd = argv[i++];
+		int left = argc - i;
+
+		if (!strcmp(cmd, "extract") && left >= 3) {
+			ret = cmd_extract(argv[i], argv[i + 1], argv[i + 2]);
+			i += 3;
+		} else if (!strcmp(cmd, "load") && left >= 1) {
+			ret = cmd_load(argv[i++]);
+		} else if (!strcmp(cmd, "reverse")) {
+			cmd_reverse();
+		} else if (!strcmp(cmd, "patch") && left >= 2) {
+			const char *csum = optional_arg(argc, argv, i + 2) ? argv[i + 2] : NULL;
+
+			ret = cmd_patch(argv[i], NULL, argv[i + 1], csum);
+			i += csum ? 3 : 2;
+		} else if (!strcmp(cmd, "patch-if") && left >= 3) {
+			const char *csum = optional_arg(argc, argv, i + 3) ? argv[i + 3] : NULL;
+
+			ret = cmd_patch(argv[i], argv[i + 1], argv[i + 2], csum);
+			i += csum ? 4 : 3;
+		} else if (!strcmp(cmd, "write") && left >= 1) {
+			ret = cmd_write(argv[i++]);
+		} else {
+			usage();
+		}
+	}
+
+	free(buf);
+
+	return ret ? 1 : 0;
+}
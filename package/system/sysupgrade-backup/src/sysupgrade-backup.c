@@ -0,0 +1,734 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sysupgrade-backup - build the list of files saved by sysupgrade
+ *
+ * Native replacement for the list_changed_conffiles() and
+ * build_list_of_backup_*_files() helpers of /sbin/sysupgrade. Conffiles
+ * are read from the opkg status file or the apk *.conffiles_static files
+ * and hashed in-process instead of forking sha256sum once per file.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define OPKG_STATUS	"/usr/lib/opkg/status"
+#define OPKG_INFO	"/usr/lib/opkg/info"
+#define APK_PACKAGES	"/lib/apk/packages"
+#define OVERLAY_UPPER	"/overlay/upper"
+#define ROM_DIR		"/rom"
+
+struct strlist {
+	char **s;
+	size_t n, size;
+};
+
+struct conffile {
+	char *path;
+	char *csum;
+};
+
+static struct conffile *conffiles;
+static size_t n_conffiles, size_conffiles;
+
+static const char *root = "";
+static bool skip_unchanged;
+
+/* SHA-256 */
+
+struct sha256 {
+	uint32_t h[8];
+	uint64_t len;
+	uint8_t buf[64];
+	size_t fill;
+};
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(struct sha256 *c, const uint8_t *p)
+{
+	uint32_t w[64], s[8], t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+		       (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+	for (; i < 64; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+		       (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+		       (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+	memcpy(s, c->h, sizeof(s));
+	for (i = 0; i < 64; i++) {
+		t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+		     ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+		t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+		     ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		memmove(&s[1], &s[0], 7 * sizeof(s[0]));
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+
+	for (i = 0; i < 8; i++)
+		c->h[i] += s[i];
+}
+
+static void sha256_init(struct sha256 *c)
+{
+	static const uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(c->h, h, sizeof(h));
+	c->len = 0;
+	c->fill = 0;
+}
+
+static void sha256_update(struct sha256 *c, const uint8_t *p, size_t len)
+{
+	c->len += len;
+	while (len > 0) {
+		size_t cur = 64 - c->fill;
+
+		if (cur > len)
+			cur = len;
+		memcpy(c->buf + c->fill, p, cur);
+		c->fill += cur;
+		p += cur;
+		len -= cur;
+		if (c->fill == 64) {
+			sha256_block(c, c->buf);
+			c->fill = 0;
+		}
+	}
+}
+
+static void sha256_hex(struct sha256 *c, char *out)
+{
+	uint64_t bits = c->len * 8;
+	uint8_t pad = 0x80;
+	int i;
+
+	sha256_update(c, &pad, 1);
+	pad = 0;
+	while (c->fill != 56)
+		sha256_update(c, &pad, 1);
+	for (i = 7; i >= 0; i--) {
+		uint8_t b = bits >> (8 * i);
+
+		sha256_update(c, &b, 1);
+	}
+
+	for (i = 0; i < 8; i++)
+		sprintf(out + 8 * i, "%08x", c->h[i]);
+}
+
+static int sha256_file(const char *path, char *out)
+{
+	struct sha256 c;
+	uint8_t buf[16384];
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	sha256_init(&c);
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		sha256_update(&c, buf, len);
+	close(fd);
+
+	if (len < 0)
+		return -1;
+
+	sha256_hex(&c, out);
+	return 0;
+}
+
+/* string lists */
+
+static void strlist_add(struct strlist *l, const char *s)
+{
+	if (l->n >= l->size) {
+		l->size = l->size ? l->size * 2 : 256;
+		l->s = realloc(l->s, l->size * sizeof(*l->s));
+		if (!l->s) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	l->s[l->n] = strdup(s);
+	if (!l->s[l->n++]) {
+		perror("strdup");
+		exit(1);
+	}
+}
+
+static int strp_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* sort -u */
+static void strlist_sort(struct strlist *l)
+{
+	size_t i, n = 0;
+
+	if (!l->n)
+		return;
+
+	qsort(l->s, l->n, sizeof(*l->s), strp_cmp);
+	for (i = 1; i < l->n; i++) {
+		if (!strcmp(l->s[i], l->s[n])) {
+			free(l->s[i]);
+			continue;
+		}
+		l->s[++n] = l->s[i];
+	}
+	l->n = n + 1;
+}
+
+/* l must be sorted */
+static bool strlist_has(const struct strlist *l, const char *s)
+{
+	return l->n && bsearch(&s, l->s, l->n, sizeof(*l->s), strp_cmp);
+}
+
+static void strlist_print(const struct strlist *l)
+{
+	size_t i;
+
+	for (i = 0; i < l->n; i++)
+		puts(l->s[i]);
+}
+
+static char *root_path(const char *prefix, const char *path)
+{
+	static char buf[2][PATH_MAX];
+	static int cur;
+
+	cur = !cur;
+	snprintf(buf[cur], sizeof(buf[cur]), "%s%s%s", root, prefix, path);
+
+	return buf[cur];
+}
+
+/* conffiles */
+
+static void conffile_add(char *line)
+{
+	char *path, *csum;
+
+	path = strtok(line, " \t\n");
+	if (!path)
+		return;
+	csum = strtok(NULL, " \t\n");
+
+	if (n_conffiles >= size_conffiles) {
+		size_conffiles = size_conffiles ? size_conffiles * 2 : 256;
+		conffiles = realloc(conffiles, size_conffiles * sizeof(*conffiles));
+		if (!conffiles) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	conffiles[n_conffiles].path = strdup(path);
+	conffiles[n_conffiles++].csum = csum ? strdup(csum) : NULL;
+}
+
+static void read_opkg_conffiles(FILE *f)
+{
+	bool in_conffiles = false;
+	char line[PATH_MAX + 128];
+
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, "Conffiles:", 10)) {
+			in_conffiles = true;
+			continue;
+		}
+		if (line[0] != ' ') {
+			in_conffiles = false;
+			continue;
+		}
+		if (in_conffiles)
+			conffile_add(line);
+	}
+}
+
+static bool has_suffix(const char *s, const char *suffix)
+{
+	size_t len = strlen(s), slen = strlen(suffix);
+
+	return len >= slen && !strcmp(s + len - slen, suffix);
+}
+
+static void read_apk_conffiles(const char *dir)
+{
+	char line[PATH_MAX + 128];
+	struct dirent *e;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((e = readdir(d)) != NULL) {
+		char path[PATH_MAX];
+		FILE *f;
+
+		if (!has_suffix(e->d_name, ".conffiles_static"))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		while (fgets(line, sizeof(line), f))
+			conffile_add(line);
+		fclose(f);
+	}
+	closedir(d);
+}
+
+static void read_conffiles(void)
+{
+	FILE *f;
+
+	f = fopen(root_path(OPKG_STATUS, ""), "r");
+	if (f) {
+		read_opkg_conffiles(f);
+		fclose(f);
+		return;
+	}
+
+	read_apk_conffiles(root_path(APK_PACKAGES, ""));
+}
+
+static void list_changed_conffiles(struct strlist *out)
+{
+	char hash[65];
+	size_t i;
+
+	for (i = 0; i < n_conffiles; i++) {
+		const char *path = root_path(conffiles[i].path, "");
+
+		if (access(path, R_OK))
+			continue;
+
+		if (conffiles[i].csum && !sha256_file(path, hash) &&
+		    !strcmp(hash, conffiles[i].csum))
+			continue;
+
+		strlist_add(out, conffiles[i].path);
+	}
+}
+
+/* find filters */
+
+static bool same_content(const char *a, const char *b)
+{
+	char buf1[8192], buf2[8192];
+	bool ret = false;
+	int fd1, fd2;
+
+	fd1 = open(a, O_RDONLY);
+	fd2 = open(b, O_RDONLY);
+	if (fd1 < 0 || fd2 < 0)
+		goto out;
+
+	while (1) {
+		ssize_t len1 = read(fd1, buf1, sizeof(buf1));
+		ssize_t len2 = len1 > 0 ? read(fd2, buf2, len1) : read(fd2, buf2, 1);
+
+		if (len1 < 0 || len2 < 0 || len1 != len2)
+			break;
+		if (!len1) {
+			ret = true;
+			break;
+		}
+		if (memcmp(buf1, buf2, len1))
+			break;
+	}
+
+out:
+	if (fd1 >= 0)
+		close(fd1);
+	if (fd2 >= 0)
+		close(fd2);
+	return ret;
+}
+
+/* -u: skip files that are identical to the ones in /rom */
+static bool unchanged(const char *path)
+{
+	const char *rom = root_path(ROM_DIR, path);
+	struct stat st;
+
+	if (!skip_unchanged || stat(rom, &st))
+		return false;
+
+	return same_content(root_path(path, ""), rom);
+}
+
+/*
+ * Add all files and symlinks below @path (relative to @prefix) to @out,
+ * like find <path> \( -type f -o -type l \)
+ */
+static void find_files(const char *prefix, const char *path, struct strlist *out)
+{
+	struct dirent *e;
+	struct stat st;
+	DIR *d;
+
+	if (lstat(root_path(prefix, path), &st))
+		return;
+
+	if (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode)) {
+		if (!unchanged(path))
+			strlist_add(out, path);
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode))
+		return;
+
+	d = opendir(root_path(prefix, path));
+	if (!d)
+		return;
+
+	while ((e = readdir(d)) != NULL) {
+		char sub[PATH_MAX];
+
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+			continue;
+
+		snprintf(sub, sizeof(sub), "%s%s%s", path,
+			 has_suffix(path, "/") ? "" : "/", e->d_name);
+		find_files(prefix, sub, out);
+	}
+	closedir(d);
+}
+
+static void read_keep_file(const char *file, struct strlist *out)
+{
+	char line[PATH_MAX];
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		char *word;
+
+		if (line[0] == '#')
+			continue;
+
+		/* entries are subject to word splitting and globbing */
+		for (word = strtok(line, " \t\n"); word; word = strtok(NULL, " \t\n")) {
+			glob_t g;
+			size_t i, len = strlen(root);
+
+			if (glob(root_path(word, ""), GLOB_NOCHECK, NULL, &g))
+				continue;
+			for (i = 0; i < g.gl_pathc; i++)
+				find_files("", g.gl_pathv[i] + len, out);
+			globfree(&g);
+		}
+	}
+	fclose(f);
+}
+
+/* files listed in /etc/sysupgrade.conf and /lib/upgrade/keep.d */
+static void list_static_conffiles(struct strlist *out)
+{
+	struct dirent *e;
+	char path[PATH_MAX];
+	DIR *d;
+
+	read_keep_file(root_path("/etc/sysupgrade.conf", ""), out);
+
+	d = opendir(root_path("/lib/upgrade/keep.d", ""));
+	if (!d)
+		return;
+
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s",
+			 root_path("/lib/upgrade/keep.d", ""), e->d_name);
+		read_keep_file(path, out);
+	}
+	closedir(d);
+}
+
+/* files installed by packages, including alternatives */
+static void read_lines(const char *file, struct strlist *out)
+{
+	char line[PATH_MAX];
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = 0;
+		strlist_add(out, line);
+	}
+	fclose(f);
+}
+
+/* alternatives are "<prio>:<path>:<target>" */
+static void add_alternative(char *alt, struct strlist *out)
+{
+	char *path = strchr(alt, ':');
+
+	if (!path)
+		return;
+	path++;
+	path[strcspn(path, ":")] = 0;
+	strlist_add(out, path);
+}
+
+static void read_alternatives(const char *file, bool opkg, struct strlist *out)
+{
+	char line[PATH_MAX * 4];
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p = line, *alt;
+
+		if (opkg) {
+			if (strncmp(line, "Alternatives: ", 14))
+				continue;
+			p += 14;
+		}
+
+		for (alt = strtok(p, opkg ? ",\n" : " \n"); alt;
+		     alt = strtok(NULL, opkg ? ",\n" : " \n"))
+			add_alternative(alt + strspn(alt, " "), out);
+	}
+	fclose(f);
+}
+
+static void list_package_files(struct strlist *out)
+{
+	const char *dir = root_path(OPKG_INFO, "");
+	bool opkg = true;
+	struct dirent *e;
+	DIR *d;
+
+	if (access(root_path(OPKG_STATUS, ""), F_OK)) {
+		opkg = false;
+		dir = root_path(APK_PACKAGES, "");
+	}
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((e = readdir(d)) != NULL) {
+		char path[PATH_MAX];
+
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		if (has_suffix(e->d_name, ".list"))
+			read_lines(path, out);
+		else if (has_suffix(e->d_name, opkg ? ".control" : ".alternatives"))
+			read_alternatives(path, opkg, out);
+	}
+	closedir(d);
+}
+
+static bool overlay_excluded(const char *path)
+{
+	static const char * const files[] = {
+		"/etc/board.json",
+		"/etc/urandom.seed",
+		"/etc/apk/world",
+		"/etc/apk/repositories.d/distfeeds.list",
+		"/etc/backup/installed_packages.txt",
+		"/run",
+	};
+	static const char * const prefixes[] = {
+		"/etc/luci-uploads/.placeholder",
+		"/usr/lib/opkg/",
+		"/lib/apk/",
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+		if (!strcmp(path, files[i]))
+			return true;
+
+	for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+		if (!strncmp(path, prefixes[i], strlen(prefixes[i])))
+			return true;
+
+	return has_suffix(path, "-opkg") || has_suffix(path, ".apk-new");
+}
+
+static int list_config(void)
+{
+	struct strlist files = {};
+
+	list_static_conffiles(&files);
+	read_conffiles();
+	list_changed_conffiles(&files);
+	strlist_sort(&files);
+	strlist_print(&files);
+
+	return 0;
+}
+
+static int list_overlay(const char *path)
+{
+	struct strlist conf = {}, keep = {}, pkg = {}, files = {};
+	size_t i, j;
+
+	if (!strcmp(path, "/")) {
+		bool saved = skip_unchanged;
+
+		read_conffiles();
+		for (i = 0; i < n_conffiles; i++)
+			strlist_add(&conf, conffiles[i].path);
+		strlist_sort(&conf);
+
+		/*
+		 * backup files from /etc/sysupgrade.conf and keep.d, but
+		 * ignore those already controlled by conffiles
+		 */
+		skip_unchanged = false;
+		list_static_conffiles(&keep);
+		skip_unchanged = saved;
+		strlist_sort(&keep);
+		for (i = 0, j = 0; i < keep.n; i++) {
+			if (strlist_has(&conf, keep.s[i]))
+				free(keep.s[i]);
+			else
+				keep.s[j++] = keep.s[i];
+		}
+		keep.n = j;
+
+		/* backup conffiles, but only those changed if -u */
+		if (skip_unchanged) {
+			for (i = 0; i < conf.n; i++)
+				free(conf.s[i]);
+			conf.n = 0;
+			list_changed_conffiles(&conf);
+			strlist_sort(&conf);
+		}
+
+		/* do not backup files from packages, except conffiles and keep.d */
+		list_package_files(&pkg);
+		strlist_sort(&pkg);
+	}
+
+	find_files(OVERLAY_UPPER, path, &files);
+	strlist_sort(&files);
+
+	for (i = 0; i < files.n; i++) {
+		const char *f = files.s[i];
+
+		if (overlay_excluded(f))
+			continue;
+		if (strlist_has(&pkg, f) && !strlist_has(&conf, f) &&
+		    !strlist_has(&keep, f))
+			continue;
+		puts(f);
+	}
+
+	return 0;
+}
+
+static int list_changed(void)
+{
+	struct strlist files = {};
+
+	read_conffiles();
+	list_changed_conffiles(&files);
+	strlist_sort(&files);
+	strlist_print(&files);
+
+	return 0;
+}
+
+static int usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-u] [-R <root>] <command>\n"
+		"\n"
+		"Commands:\n"
+		"	changed		list changed conffiles\n"
+		"	config		list files to back up (keep.d and changed conffiles)\n"
+		"	overlay <path>	list changed files below <path> in the overlay\n"
+		"\n"
+		"Options:\n"
+		"	-u		skip files that are equal to those in /rom\n"
+		"	-R <root>	prefix for all paths\n",
+		prog);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *prog = argv[0];
+	int ch;
+
+	while ((ch = getopt(argc, argv, "uR:")) != -1) {
+		switch (ch) {
+		case 'u':
+			skip_unchanged = true;
+			break;
+		case 'R':
+			root = optarg;
+			break;
+		default:
+			return usage(prog);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+	if (argc < 1)
+		return usage(prog);
+
+	if (!strcmp(argv[0], "changed"))
+		return list_changed();
+	if (!strcmp(argv[0], "config"))
+		return list_config();
+	if (!strcmp(argv[0], "overlay") && argc > 1)
+		return list_overlay(argv[1]);
+
+	return usage(prog);
+}
@@ -0,0 +1,578 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * tarflash - single pass sysupgrade tar flasher
+ *
+ * Parses the headers of a sysupgrade tar once and streams the kernel and
+ * root members straight into UBI volumes or flash commands, so that
+ * nand_upgrade_tar() does not have to run (and decompress) the image
+ * through tar once for every piece of information it needs.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <mtd/ubi-user.h>
+
+#define BLOCK_SIZE	512
+#define BUF_SIZE	(64 * 1024)
+#define NAME_MAX_LEN	4096
+
+struct tar_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+};
+
+struct member {
+	char name[NAME_MAX_LEN];
+	uint64_t size;
+	char type;
+};
+
+struct target {
+	const char *suffix;
+	const char *dest;
+	bool done;
+};
+
+static int in_fd = STDIN_FILENO;
+static bool seekable;
+static uint64_t offset;
+static char *buf;
+
+static int read_full(void *data, size_t len)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < len) {
+		r = read(in_fd, (char *)data + done, len - done);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		done += r;
+	}
+	offset += len;
+
+	return 0;
+}
+
+static int skip(uint64_t len)
+{
+	if (seekable) {
+		if (lseek(in_fd, len, SEEK_CUR) < 0)
+			return -1;
+		offset += len;
+		return 0;
+	}
+
+	while (len > 0) {
+		size_t cur = len > BUF_SIZE ? BUF_SIZE : len;
+
+		if (read_full(buf, cur))
+			return -1;
+		len -= cur;
+	}
+
+	return 0;
+}
+
+static uint64_t padding(uint64_t size)
+{
+	return (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+}
+
+static uint64_t parse_octal(const char *s, size_t len)
+{
+	uint64_t val = 0;
+	size_t i;
+
+	/* base-256 encoding for large values */
+	if ((unsigned char)s[0] & 0x80) {
+		val = (unsigned char)s[0] & 0x7f;
+		for (i = 1; i < len; i++)
+			val = (val << 8) | (unsigned char)s[i];
+		return val;
+	}
+
+	for (i = 0; i < len && s[i] == ' '; i++);
+	for (; i < len && s[i] >= '0' && s[i] <= '7'; i++)
+		val = (val << 3) | (s[i] - '0');
+
+	return val;
+}
+
+static bool header_valid(const struct tar_header *h)
+{
+	const unsigned char *p = (const unsigned char *)h;
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < BLOCK_SIZE; i++) {
+		if (i >= offsetof(struct tar_header, chksum) &&
+		    i < offsetof(struct tar_header, typeflag))
+			sum += ' ';
+		else
+			sum += p[i];
+	}
+
+	return sum == parse_octal(h->chksum, sizeof(h->chksum));
+}
+
+static bool block_empty(const void *data)
+{
+	const char *p = data;
+	size_t i;
+
+	for (i = 0; i < BLOCK_SIZE; i++)
+		if (p[i])
+			return false;
+
+	return true;
+}
+
+/* read a GNU long name or pax extended header into @m */
+static int read_extended(struct member *m, uint64_t size, bool pax,
+			 bool *have_name, bool *have_size)
+{
+	char *data, *p, *end;
+
+	if (size >= NAME_MAX_LEN * 4)
+		return -1;
+
+	data = calloc(1, size + 1);
+	if (!data || read_full(data, size) || skip(padding(size))) {
+		free(data);
+		return -1;
+	}
+
+	if (!pax) {
+		snprintf(m->name, sizeof(m->name), "%s", data);
+		*have_name = true;
+		free(data);
+		return 0;
+	}
+
+	/* records are "<len> <key>=<value>\n" */
+	for (p = data, end = data + size; p < end;) {
+		char *rec = p, *key, *val;
+		unsigned long len = strtoul(p, &key, 10);
+
+		if (!len || rec + len > end || *key != ' ')
+			break;
+		key++;
+		p = rec + len;
+		p[-1] = 0;
+		val = strchr(key, '=');
+		if (!val)
+			continue;
+		*val++ = 0;
+		if (!strcmp(key, "path")) {
+			snprintf(m->name, sizeof(m->name), "%s", val);
+			*have_name = true;
+		} else if (!strcmp(key, "size")) {
+			m->size = strtoull(val, NULL, 10);
+			*have_size = true;
+		}
+	}
+	free(data);
+
+	return 0;
+}
+
+/* returns 1 at the end of the archive */
+static int next_member(struct member *m)
+{
+	bool have_name = false, have_size = false;
+	struct tar_header h;
+
+	while (1) {
+		uint64_t size;
+
+		if (read_full(&h, sizeof(h))) {
+			fprintf(stderr, "Truncated tar archive\n");
+			return -1;
+		}
+
+		if (block_empty(&h))
+			return 1;
+
+		if (!header_valid(&h)) {
+			fprintf(stderr, "Invalid tar header at offset %llu\n",
+				(unsigned long long)(offset - BLOCK_SIZE));
+			return -1;
+		}
+
+		size = parse_octal(h.size, sizeof(h.size));
+		switch (h.typeflag) {
+		case 'L':
+		case 'x':
+			if (read_extended(m, size, h.typeflag == 'x',
+					  &have_name, &have_size))
+				return -1;
+			continue;
+		case 'g':
+			if (skip(size + padding(size)))
+				return -1;
+			continue;
+		}
+
+		if (!have_name) {
+			if (h.prefix[0] && !memcmp(h.magic, "ustar", 5))
+				snprintf(m->name, sizeof(m->name), "%.*s/%.*s",
+					 (int)sizeof(h.prefix), h.prefix,
+					 (int)sizeof(h.name), h.name);
+			else
+				snprintf(m->name, sizeof(m->name), "%.*s",
+					 (int)sizeof(h.name), h.name);
+		}
+		if (!have_size)
+			m->size = size;
+		m->type = h.typeflag ? h.typeflag : '0';
+
+		/* only regular files carry data */
+		if (m->type != '0' && m->type != '7')
+			m->size = 0;
+
+		return 0;
+	}
+}
+
+static int skip_data(const struct member *m)
+{
+	if (skip(m->size + padding(m->size))) {
+		fprintf(stderr, "Truncated tar archive\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* "sysupgrade-<board>/" directory entries, same as grep '^sysupgrade-.*\/$' */
+static bool is_board_dir(const struct member *m)
+{
+	size_t len = strlen(m->name);
+
+	return !strncmp(m->name, "sysupgrade-", 11) && len > 11 &&
+	       m->name[len - 1] == '/';
+}
+
+static bool is_member(const struct member *m, const char *dir,
+		      const char *suffix)
+{
+	size_t len = strlen(dir);
+
+	return !strncmp(m->name, dir, len) && m->name[len] == '/' &&
+	       !strcmp(m->name + len + 1, suffix);
+}
+
+static bool shell_safe(const char *s)
+{
+	for (; *s; s++)
+		if (!isalnum((unsigned char)*s) && !strchr("_-.,+/", *s))
+			return false;
+
+	return true;
+}
+
+static int cmd_info(const char *dir)
+{
+	char board_dir[NAME_MAX_LEN] = "";
+	uint64_t kernel_length = 0, rootfs_length = 0;
+	bool have_kernel = false, have_root = false;
+	unsigned char magic[4] = {};
+	struct member m;
+	int ret;
+
+	if (dir)
+		snprintf(board_dir, sizeof(board_dir), "%s", dir);
+
+	while ((ret = next_member(&m)) == 0) {
+		if (!board_dir[0] && is_board_dir(&m)) {
+			snprintf(board_dir, sizeof(board_dir), "%s", m.name);
+			board_dir[strlen(board_dir) - 1] = 0;
+		}
+
+		if (board_dir[0] && is_member(&m, board_dir, "kernel")) {
+			have_kernel = true;
+			kernel_length = m.size;
+		} else if (board_dir[0] && is_member(&m, board_dir, "root")) {
+			uint64_t len = m.size < 4 ? m.size : 4;
+
+			have_root = true;
+			rootfs_length = m.size;
+			if (read_full(magic, len) ||
+			    skip(m.size - len + padding(m.size))) {
+				fprintf(stderr, "Truncated tar archive\n");
+				return 1;
+			}
+			continue;
+		}
+
+		if (skip_data(&m))
+			return 1;
+	}
+
+	if (ret < 0)
+		return 1;
+
+	if (!shell_safe(board_dir)) {
+		fprintf(stderr, "Invalid board directory name\n");
+		return 1;
+	}
+
+	printf("board_dir='%s'\n", board_dir);
+	if (have_kernel)
+		printf("kernel_length=%llu\n", (unsigned long long)kernel_length);
+	if (have_root) {
+		printf("rootfs_length=%llu\n", (unsigned long long)rootfs_length);
+		printf("rootfs_magic=%02x%02x%02x%02x\n",
+		       magic[0], magic[1], magic[2], magic[3]);
+	}
+
+	return 0;
+}
+
+static int write_ubi(const char *dev, const struct member *m)
+{
+	int64_t bytes = m->size;
+	uint64_t left = m->size;
+	int fd, ret = -1;
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", dev, strerror(errno));
+		return -1;
+	}
+
+	if (ioctl(fd, UBI_IOCVOLUP, &bytes)) {
+		fprintf(stderr, "Cannot start update of %s: %s\n", dev,
+			strerror(errno));
+		goto out;
+	}
+
+	while (left > 0) {
+		size_t cur = left > BUF_SIZE ? BUF_SIZE : left;
+		size_t done = 0;
+
+		if (read_full(buf, cur)) {
+			fprintf(stderr, "Truncated tar archive\n");
+			goto out;
+		}
+
+		while (done < cur) {
+			ssize_t w = write(fd, buf + done, cur - done);
+
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w <= 0) {
+				fprintf(stderr, "Cannot write %s: %s\n", dev,
+					strerror(errno));
+				goto out;
+			}
+			done += w;
+		}
+		left -= cur;
+	}
+	ret = 0;
+
+out:
+	close(fd);
+	return ret;
+}
+
+static int write_cmd(const char *cmd, const struct member *m)
+{
+	uint64_t left = m->size;
+	int ret = 0;
+	FILE *f;
+
+	f = popen(cmd, "w");
+	if (!f) {
+		fprintf(stderr, "Cannot run '%s': %s\n", cmd, strerror(errno));
+		return -1;
+	}
+
+	while (left > 0) {
+		size_t cur = left > BUF_SIZE ? BUF_SIZE : left;
+
+		if (read_full(buf, cur)) {
+			fprintf(stderr, "Truncated tar archive\n");
+			ret = -1;
+			break;
+		}
+
+		if (fwrite(buf, 1, cur, f) != cur) {
+			fprintf(stderr, "Cannot write to '%s'\n", cmd);
+			ret = -1;
+			break;
+		}
+		left -= cur;
+	}
+
+	ret = pclose(f) ? -1 : ret;
+	if (ret)
+		fprintf(stderr, "Writing %s with '%s' failed\n", m->name, cmd);
+
+	return ret;
+}
+
+static int cmd_write(const char *dir, struct target *targets, int n_targets)
+{
+	int i, left = n_targets;
+	struct member m;
+	int ret;
+
+	if (!dir) {
+		fprintf(stderr, "No board directory given\n");
+		return 1;
+	}
+
+	while (left && (ret = next_member(&m)) == 0) {
+		struct target *t = NULL;
+
+		for (i = 0; i < n_targets; i++) {
+			if (!targets[i].done &&
+			    is_member(&m, dir, targets[i].suffix))
+				t = &targets[i];
+		}
+
+		if (!t) {
+			if (skip_data(&m))
+				return 1;
+			continue;
+		}
+
+		fprintf(stderr, "Writing %s (%llu bytes) to %s\n", m.name,
+			(unsigned long long)m.size, t->dest);
+		if (!strncmp(t->dest, "/dev/ubi", 8))
+			ret = write_ubi(t->dest, &m);
+		else
+			ret = write_cmd(t->dest, &m);
+		if (ret || skip(padding(m.size)))
+			return 1;
+
+		t->done = true;
+		left--;
+	}
+
+	for (i = 0; i < n_targets; i++) {
+		if (targets[i].done)
+			continue;
+		fprintf(stderr, "%s/%s not found in archive\n", dir,
+			targets[i].suffix);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s info [-f <file>] [-d <board dir>]\n"
+		"       %s write -d <board dir> [-k <target>] [-r <target>]\n"
+		"\n"
+		"Reads a sysupgrade tar archive from stdin (or <file>).\n"
+		"info:  prints board_dir, kernel_length, rootfs_length and\n"
+		"       rootfs_magic as shell variables\n"
+		"write: writes the kernel (-k) and root (-r) members in a single pass\n"
+		"       A target starting with /dev/ubi is updated as UBI volume,\n"
+		"       anything else is run as shell command with the data on stdin\n",
+		prog, prog);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct target targets[2];
+	const char *dir = NULL, *file = NULL;
+	const char *prog = argv[0];
+	int n_targets = 0;
+	struct stat st;
+	bool info;
+	int ch;
+
+	if (argc < 2)
+		return usage(prog);
+
+	if (!strcmp(argv[1], "info"))
+		info = true;
+	else if (!strcmp(argv[1], "write"))
+		info = false;
+	else
+		return usage(prog);
+	argv++;
+	argc--;
+
+	while ((ch = getopt(argc, argv, "d:f:k:r:")) != -1) {
+		switch (ch) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'k':
+		case 'r':
+			if (info || n_targets >= 2)
+				return usage(prog);
+			targets[n_targets].suffix = ch == 'k' ? "kernel" : "root";
+			targets[n_targets].dest = optarg;
+			targets[n_targets++].done = false;
+			break;
+		default:
+			return usage(prog);
+		}
+	}
+
+	if (file) {
+		in_fd = open(file, O_RDONLY);
+		if (in_fd < 0) {
+			fprintf(stderr, "Cannot open %s: %s\n", file, strerror(errno));
+			return 1;
+		}
+	}
+
+	/* data that is only skipped does not need to be read */
+	seekable = !fstat(in_fd, &st) && S_ISREG(st.st_mode);
+
+	buf = malloc(BUF_SIZE);
+	if (!buf)
+		return 1;
+
+	/* report failing flash commands instead of dying on a closed pipe */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (info)
+		return cmd_info(dir);
+
+	return cmd_write(dir, targets, n_targets);
+}
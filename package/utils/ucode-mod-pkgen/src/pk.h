@@ -41,5 +41,6 @@ extern char buf[32 * 1024];
 } while (0)
 
 #define INVALID_ARG()	do { C(-1); return NULL; } while (0)
+#define IO_ERROR()	do { C(MBEDTLS_ERR_PK_FILE_IO_ERROR); return NULL; } while (0)
 
 #endif
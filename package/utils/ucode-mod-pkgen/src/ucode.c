@@ -4,12 +4,17 @@
  */
 #include <sys/types.h>
 #include <sys/random.h>
+#include <sys/stat.h>
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <limits.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <mbedtls/entropy.h>
+#include <mbedtls/platform_util.h>
 #include <mbedtls/x509_crt.h>
 #include <mbedtls/ecp.h>
 #include <mbedtls/rsa.h>
@@ -18,6 +23,8 @@
 
 #include "pk.h"
 
+#define PKGEN_POOL_DIR	"/usr/lib/pkgen/pool"
+
 /* mbedtls < 3.x compat */
 #ifdef MBEDTLS_LEGACY
 #define mbedtls_pk_parse_key(pk, key, keylen, passwd, passwdlen, random, random_ctx) \
@@ -127,6 +134,226 @@ static void free_pk(void *pk)
 	free(pk);
 }
 
+static int
+pk_type_get(uc_value_t *arg, mbedtls_pk_type_t *pk_type)
+{
+	const char *type;
+
+	type = ucv_string_get(ucv_object_get(arg, "type", NULL));
+	if (!type)
+		return -1;
+
+	if (!strcmp(type, "rsa"))
+		*pk_type = MBEDTLS_PK_RSA;
+	else if (!strcmp(type, "ec"))
+		*pk_type = MBEDTLS_PK_ECKEY;
+	else
+		return -1;
+
+	return 0;
+}
+
+static int
+pk_generate(mbedtls_pk_context *pk, mbedtls_pk_type_t pk_type, uc_value_t *arg)
+{
+	mbedtls_pk_setup(pk, mbedtls_pk_info_from_type(pk_type));
+	switch (pk_type) {
+	case MBEDTLS_PK_RSA:
+		return gen_rsa_key(pk, arg);
+	case MBEDTLS_PK_ECKEY:
+		return gen_ec_key(pk, arg);
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Pool of pregenerated private keys, filled in the background by
+ * "pkgen pool". Each key type and parameter set has its own directory
+ * below the pool directory, holding one DER encoded key per file. A key
+ * is claimed by renaming it, so that it is handed out only once, and
+ * removed before it is used.
+ */
+static const char *pool_dir(void)
+{
+	const char *dir = getenv("PKGEN_POOL_DIR");
+
+	return dir ? dir : PKGEN_POOL_DIR;
+}
+
+static int
+pool_path(char *path, size_t len, mbedtls_pk_type_t pk_type, uc_value_t *arg)
+{
+	const mbedtls_ecp_curve_info *curve_info;
+	int64_t key_size, exp;
+	uc_value_t *c_arg;
+	int ret;
+
+	switch (pk_type) {
+	case MBEDTLS_PK_RSA:
+		key_size = get_int_arg(arg, "size", 2048);
+		exp = get_int_arg(arg, "exponent", 65537);
+		if (key_size < 0 || exp < 0)
+			return -1;
+
+		ret = snprintf(path, len, "%s/rsa-%d-%d", pool_dir(),
+			       (int)key_size, (int)exp);
+		break;
+	case MBEDTLS_PK_ECKEY:
+		c_arg = ucv_object_get(arg, "curve", NULL);
+		if (c_arg && ucv_type(c_arg) != UC_STRING)
+			return -1;
+
+		curve_info = mbedtls_ecp_curve_info_from_name(c_arg ? ucv_string_get(c_arg) : "secp256r1");
+		if (!curve_info)
+			return -1;
+
+		ret = snprintf(path, len, "%s/ec-%s", pool_dir(), curve_info->name);
+		break;
+	default:
+		return -1;
+	}
+
+	return ret < 0 || (size_t)ret >= len ? -1 : 0;
+}
+
+static bool
+pool_get_key(mbedtls_pk_context *pk, mbedtls_pk_type_t pk_type, uc_value_t *arg)
+{
+	char path[PATH_MAX], file[PATH_MAX], claim[PATH_MAX];
+	struct dirent *e;
+	bool found = false;
+	ssize_t len;
+	DIR *d;
+	int fd;
+
+	if (pool_path(path, sizeof(path), pk_type, arg))
+		return false;
+
+	d = opendir(path);
+	if (!d)
+		return false;
+
+	snprintf(claim, sizeof(claim), "%s/.claim-%d", path, (int)getpid());
+	while (!found && (e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.')
+			continue;
+
+		snprintf(file, sizeof(file), "%s/%s", path, e->d_name);
+		if (rename(file, claim))
+			continue;
+
+		fd = open(claim, O_RDONLY | O_CLOEXEC);
+		unlink(claim);
+		if (fd < 0)
+			continue;
+
+		len = read(fd, buf, sizeof(buf));
+		close(fd);
+
+		if (len > 0 &&
+		    !mbedtls_pk_parse_key(pk, (const uint8_t *)buf, len, NULL, 0, random_cb, NULL) &&
+		    mbedtls_pk_get_type(pk) == pk_type)
+			found = true;
+		mbedtls_platform_zeroize(buf, sizeof(buf));
+
+		if (!found) {
+			mbedtls_pk_free(pk);
+			mbedtls_pk_init(pk);
+		}
+	}
+	closedir(d);
+
+	return found;
+}
+
+static int
+pool_mkdir(char *path)
+{
+	char *p = path;
+
+	while ((p = strchr(p + 1, '/')) != NULL) {
+		*p = 0;
+		if (mkdir(path, 0700) && errno != EEXIST) {
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+
+	return mkdir(path, 0700) && errno != EEXIST ? -1 : 0;
+}
+
+static int
+pool_count(const char *path)
+{
+	struct dirent *e;
+	int n = 0;
+	DIR *d;
+
+	d = opendir(path);
+	if (!d)
+		return -1;
+
+	while ((e = readdir(d)) != NULL)
+		if (e->d_name[0] != '.')
+			n++;
+	closedir(d);
+
+	return n;
+}
+
+static int
+pool_write_key(const char *path, mbedtls_pk_context *pk)
+{
+	char tmp[PATH_MAX], file[PATH_MAX];
+	size_t len, done = 0;
+	uint8_t id[8];
+	int ret, fd;
+
+	ret = C(mbedtls_pk_write_key_der(pk, (void *)buf, sizeof(buf)));
+	if (ret < 0)
+		goto out;
+
+	len = ret;
+	ret = random_cb(NULL, id, sizeof(id));
+	if (ret)
+		goto out;
+
+	ret = MBEDTLS_ERR_PK_FILE_IO_ERROR;
+
+	snprintf(tmp, sizeof(tmp), "%s/.new-%d", path, (int)getpid());
+	snprintf(file, sizeof(file), "%s/%02x%02x%02x%02x%02x%02x%02x%02x.der", path,
+		 id[0], id[1], id[2], id[3], id[4], id[5], id[6], id[7]);
+
+	unlink(tmp);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0)
+		goto out;
+
+	while (done < len) {
+		ssize_t w = write(fd, buf + sizeof(buf) - len + done, len - done);
+
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			break;
+
+		done += w;
+	}
+
+	if (done == len && !fsync(fd))
+		ret = 0;
+	if (close(fd) || (!ret && rename(tmp, file)))
+		ret = MBEDTLS_ERR_PK_FILE_IO_ERROR;
+	if (ret)
+		unlink(tmp);
+
+out:
+	mbedtls_platform_zeroize(buf, sizeof(buf));
+	return ret;
+}
+
 static void free_crt(void *ptr)
 {
 	struct uc_cert_wr *crt = ptr;
@@ -143,41 +370,27 @@ static void free_crt(void *ptr)
 static uc_value_t *
 uc_generate_key(uc_vm_t *vm, size_t nargs)
 {
-	uc_value_t *cur, *arg = uc_fn_arg(0);
+	uc_value_t *pool, *arg = uc_fn_arg(0);
 	mbedtls_pk_type_t pk_type;
 	mbedtls_pk_context *pk;
-	const char *type;
 	int ret;
 
 	if (ucv_type(arg) != UC_OBJECT)
 		INVALID_ARG();
 
-	cur = ucv_object_get(arg, "type", NULL);
-	type = ucv_string_get(cur);
-	if (!type)
-		INVALID_ARG();
-
-	if (!strcmp(type, "rsa"))
-		pk_type = MBEDTLS_PK_RSA;
-	else if (!strcmp(type, "ec"))
-		pk_type = MBEDTLS_PK_ECKEY;
-	else
+	if (pk_type_get(arg, &pk_type))
 		INVALID_ARG();
 
 	pk = calloc(1, sizeof(*pk));
 	mbedtls_pk_init(pk);
-	mbedtls_pk_setup(pk, mbedtls_pk_info_from_type(pk_type));
-	switch (pk_type) {
-	case MBEDTLS_PK_RSA:
-		ret = C(gen_rsa_key(pk, arg));
-		break;
-	case MBEDTLS_PK_ECKEY:
-		ret = C(gen_ec_key(pk, arg));
-		break;
-	default:
-		ret = -1;
+
+	pool = ucv_object_get(arg, "pool", NULL);
+	if ((!pool || ucv_is_truish(pool)) && pool_get_key(pk, pk_type, arg)) {
+		C(0);
+		return uc_resource_new(uc_pk_type, pk);
 	}
 
+	ret = C(pk_generate(pk, pk_type, arg));
 	if (ret) {
 		free_pk(pk);
 		return NULL;
@@ -186,6 +399,46 @@ uc_generate_key(uc_vm_t *vm, size_t nargs)
 	return uc_resource_new(uc_pk_type, pk);
 }
 
+static uc_value_t *
+uc_pool_fill(uc_vm_t *vm, size_t nargs)
+{
+	uc_value_t *arg = uc_fn_arg(0);
+	uc_value_t *count = uc_fn_arg(1);
+	mbedtls_pk_type_t pk_type;
+	mbedtls_pk_context pk;
+	char path[PATH_MAX];
+	int n, ret;
+
+	if (ucv_type(arg) != UC_OBJECT || ucv_type(count) != UC_INTEGER ||
+	    ucv_int64_get(count) < 0 || ucv_int64_get(count) > INT_MAX)
+		INVALID_ARG();
+
+	if (pk_type_get(arg, &pk_type) ||
+	    pool_path(path, sizeof(path), pk_type, arg))
+		INVALID_ARG();
+
+	if (pool_mkdir(path))
+		IO_ERROR();
+
+	n = pool_count(path);
+	if (n < 0)
+		IO_ERROR();
+
+	while (n < ucv_int64_get(count)) {
+		mbedtls_pk_init(&pk);
+		ret = C(pk_generate(&pk, pk_type, arg));
+		if (!ret)
+			ret = C(pool_write_key(path, &pk));
+		mbedtls_pk_free(&pk);
+		if (ret)
+			return NULL;
+
+		n++;
+	}
+
+	return ucv_int64_new(n);
+}
+
 static uc_value_t *
 uc_load_key(uc_vm_t *vm, size_t nargs)
 {
@@ -581,6 +834,7 @@ static const uc_function_list_t global_fns[] = {
 	{ "load_key", uc_load_key },
 	{ "cert_info", uc_cert_info },
 	{ "generate_key", uc_generate_key },
+	{ "pool_fill", uc_pool_fill },
 	{ "generate_cert", uc_generate_cert },
 	{ "generate_pkcs12", uc_generate_pkcs12 },
 	{ "errno", uc_mbedtls_errno },
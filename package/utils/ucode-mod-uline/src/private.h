@@ -176,6 +176,11 @@ static inline void vt100_erase(FILE *out, int count)
 	__vt100_csi_num(out, count, 'P');
 }
 
+static inline void vt100_insert(FILE *out, int count)
+{
+	__vt100_csi_num(out, count, '@');
+}
+
 static inline void vt100_erase_down(FILE *out)
 {
 	__vt100_csi2(out, 'J', 0);
@@ -136,6 +136,17 @@ uc_uline_get_window(uc_vm_t *vm, size_t nargs)
 	return val;
 }
 
+static uc_value_t *
+uc_uline_get_output_bytes(uc_vm_t *vm, size_t nargs)
+{
+	struct uc_uline_state *us = uc_fn_thisval("uline.state");
+
+	if (!us)
+		return NULL;
+
+	return ucv_int64_new(us->s.output_bytes);
+}
+
 static uc_value_t *
 uc_uline_get_line(uc_vm_t *vm, size_t nargs)
 {
@@ -884,6 +895,7 @@ static const uc_function_list_t state_fns[] = {
 	{ "reset_key_input", uc_uline_reset_key_input },
 	{ "get_line", uc_uline_get_line },
 	{ "get_window", uc_uline_get_window },
+	{ "get_output_bytes", uc_uline_get_output_bytes },
 	{ "set_hint", uc_uline_set_hint },
 	{ "set_state", uc_uline_set_state },
 	{ "set_uloop", uc_uline_set_uloop },
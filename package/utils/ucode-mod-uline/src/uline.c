@@ -92,6 +92,7 @@ linebuf_free(struct linebuf *line)
 {
 	free(line->buf);
 	free(line->prompt);
+	free(line->shown);
 }
 
 static void
@@ -102,7 +103,7 @@ update_window_size(struct uline_state *s, bool init)
 	struct winsize ws = {};
 
 	if (s->ioctl_winsize &&
-	    !ioctl(fileno(s->output), TIOCGWINSZ, &ws) &&
+	    !ioctl(fileno(s->output_stream), TIOCGWINSZ, &ws) &&
 	    ws.ws_col && ws.ws_row) {
 		cols = ws.ws_col;
 		rows = ws.ws_row;
@@ -218,9 +219,6 @@ linebuf_insert(struct linebuf *line, char *c, size_t len)
 	else
 		dest[len] = 0;
 
-	if (line->update_pos > line->pos)
-		line->update_pos = line->pos;
-
 	memcpy(dest, c, len);
 	line->len += len;
 	line->pos += len;
@@ -236,9 +234,6 @@ linebuf_delete(struct linebuf *line, size_t len)
 	ssize_t tail = line->len - line->pos;
 	size_t max_len = line->len - line->pos;
 
-	if (line->update_pos > line->pos)
-		line->update_pos = line->pos;
-
 	if (len > max_len)
 		len = max_len;
 
@@ -368,84 +363,208 @@ display_output_string(struct uline_state *s, const char *str,
 }
 
 static void
-display_update_line(struct uline_state *s, struct linebuf *line,
-		    struct pos *pos)
+display_write(struct uline_state *s, const char *str, size_t len)
 {
-	char *start = line->buf;
-	char *end = line->buf + line->len;
-	struct pos update_pos;
-	size_t prompt_len = 0;
+	if (!len)
+		return;
 
-	if (line->prompt)
-		prompt_len = strlen(line->prompt);
+	display_output_string(s, str, len);
+	if (s->cursor_pos.x == 0 && str[len - 1] != '\n')
+		vt100_next_line(s->output);
+}
 
-	if (s->full_update) {
-		display_output_string(s, line->prompt, prompt_len);
-		*pos = s->cursor_pos;
-		line->update_pos = 0;
-	} else {
-		pos_add_string(s, pos, line->prompt, prompt_len);
-	}
+static bool
+display_simple_text(const char *str, size_t len)
+{
+	return !memchr(str, '\n', len) && !memchr(str, KEY_ESC, len);
+}
+
+static bool
+linebuf_set_shown(struct linebuf *line)
+{
+	char *shown = line->shown;
 
-	update_pos = *pos;
-	if (line->update_pos) {
-		start += line->update_pos;
-		pos_add_string(s, &update_pos, line->buf, line->update_pos);
+	if (line->shown_size < line->len + 1) {
+		shown = realloc(line->shown, line->len + 1);
+		if (!shown) {
+			line->shown_len = 0;
+			return false;
+		}
+
+		line->shown = shown;
+		line->shown_size = line->len + 1;
 	}
-	set_cursor(s, update_pos);
-	vt100_erase_right(s->output);
-	line->update_pos = line->len;
 
-	if (end - start <= 0)
+	if (line->len)
+		memcpy(shown, line->buf, line->len);
+	line->shown_len = line->len;
+
+	return true;
+}
+
+static void
+display_redraw_line(struct uline_state *s, struct linebuf *line,
+		    const char *buf, struct pos *pos)
+{
+	size_t prompt_len = line->prompt ? strlen(line->prompt) : 0;
+
+	display_output_string(s, line->prompt, prompt_len);
+	*pos = s->cursor_pos;
+	display_write(s, buf, line->len);
+}
+
+/*
+ * Compare the text with what is shown on the terminal and only redraw the
+ * part that changed. Insertions and deletions that do not affect the line
+ * wrapping are done with the insert/delete character sequences, anything
+ * else is rewritten up to the end of the text.
+ */
+static void
+display_diff_line(struct uline_state *s, struct linebuf *line,
+		  const char *buf, struct pos *pos)
+{
+	const char *old = line->shown;
+	size_t old_len = line->shown_len, len = line->len;
+	size_t prefix = 0, suffix = 0;
+	size_t old_mid, new_mid;
+	ssize_t old_syms, new_syms;
+	struct pos start, end;
+
+	if (line->prompt)
+		pos_add_string(s, pos, line->prompt, strlen(line->prompt));
+
+	while (prefix < old_len && prefix < len && old[prefix] == buf[prefix])
+		prefix++;
+	while (s->utf8 && prefix > 0 &&
+	       ((prefix < len && is_utf8_cont(buf[prefix])) ||
+	        (prefix < old_len && is_utf8_cont(old[prefix]))))
+		prefix--;
+
+	while (suffix < old_len - prefix && suffix < len - prefix &&
+	       old[old_len - 1 - suffix] == buf[len - 1 - suffix])
+		suffix++;
+	while (s->utf8 && suffix > 0 && is_utf8_cont(buf[len - suffix]))
+		suffix--;
+
+	old_mid = old_len - prefix - suffix;
+	new_mid = len - prefix - suffix;
+	if (!old_mid && !new_mid)
 		return;
 
-	display_output_string(s, start, end - start);
-	if (s->cursor_pos.x == 0 && end[-1] != '\n')
-		vt100_next_line(s->output);
+	start = *pos;
+	pos_add_string(s, &start, buf, prefix);
+	end = start;
+	pos_add_string(s, &end, buf + prefix, len - prefix);
+
+	if (display_simple_text(old + prefix, old_len - prefix) &&
+	    display_simple_text(buf + prefix, len - prefix)) {
+		old_syms = nsyms(s, old + prefix, old_mid);
+		new_syms = nsyms(s, buf + prefix, new_mid);
+
+		if (old_syms == new_syms) {
+			set_cursor(s, start);
+			display_write(s, buf + prefix, new_mid);
+			return;
+		}
+
+		if (suffix && start.y == end.y && start.y == line->end.y) {
+			set_cursor(s, start);
+			if (new_syms > old_syms)
+				vt100_insert(s->output, new_syms - old_syms);
+			display_write(s, buf + prefix, new_mid);
+			if (old_syms > new_syms)
+				vt100_erase(s->output, old_syms - new_syms);
+			return;
+		}
+	}
+
+	set_cursor(s, start);
+	display_write(s, buf + prefix, len - prefix);
+
+	if (line->end.y > end.y)
+		vt100_erase_down(s->output);
+	else if (line->end.y == end.y && line->end.x > end.x)
+		vt100_erase_right(s->output);
+}
+
+static void
+display_update_line(struct uline_state *s, struct linebuf *line,
+		    struct pos *pos, bool redraw)
+{
+	const char *buf = line->buf ? line->buf : "";
+	struct pos start = *pos;
+
+	if (redraw)
+		display_redraw_line(s, line, buf, pos);
+	else
+		display_diff_line(s, line, buf, pos);
+
+	line->start = start;
+	line->end = *pos;
+	pos_add_string(s, &line->end, buf, line->len);
+
+	if (!linebuf_set_shown(line))
+		s->full_update = true;
 }
 
 static void
 display_update(struct uline_state *s)
 {
-	struct pos edit_pos, end_diff;
+	struct pos edit_pos, prev_end;
 	struct pos base_pos = {};
 	struct linebuf *line = &s->line;
+	bool full_update = s->full_update || !line->shown;
+
+	prev_end = s->line2 ? s->line2->end : line->end;
 
-	if (s->full_update) {
+	s->full_update = false;
+	if (full_update) {
 		set_cursor(s, (struct pos){});
 		fputc(KEY_CR, s->output);
 		vt100_erase_down(s->output);
+		s->hint_shown = false;
 	}
 
-	display_update_line(s, line, &base_pos);
+	display_update_line(s, line, &base_pos, full_update);
 
 	if (s->line2) {
 		line = s->line2;
 
-		if (s->cursor_pos.x != 0) {
-			vt100_next_line(s->output);
-			pos_add_newline(s, &s->cursor_pos);
+		base_pos = s->line.end;
+		if (base_pos.x != 0)
+			pos_add_newline(s, &base_pos);
+
+		if (full_update || !line->shown ||
+		    base_pos.x != line->start.x || base_pos.y != line->start.y) {
+			/* the primary line changed its height, redraw below it */
+			set_cursor(s, s->line.end);
+			if (s->cursor_pos.x != 0) {
+				vt100_next_line(s->output);
+				pos_add_newline(s, &s->cursor_pos);
+			}
+			vt100_erase_down(s->output);
+			display_update_line(s, line, &base_pos, true);
+		} else {
+			display_update_line(s, line, &base_pos, false);
 		}
+	}
 
-		base_pos = s->cursor_pos;
-		display_update_line(s, s->line2, &base_pos);
+	/*
+	 * Lines only erase what they covered before. Clear a hint below them
+	 * once the text wraps into another row, so that it does not show
+	 * through the new row.
+	 */
+	if (s->hint_shown && line->end.y != prev_end.y) {
+		set_cursor(s, line->end);
+		vt100_erase_down(s->output);
+		s->hint_shown = false;
 	}
 
 	edit_pos = base_pos;
 	pos_add_string(s, &edit_pos, line->buf, line->pos);
 
-	end_diff = pos_diff(s->end_pos, s->cursor_pos);
-	s->end_pos = s->cursor_pos;
-
-	if (end_diff.y != 0)
-		vt100_erase_down(s->output);
-	else
-		vt100_erase_right(s->output);
-
 	set_cursor(s, edit_pos);
 	fflush(s->output);
-
-	s->full_update = false;
 }
 
 static bool
@@ -605,7 +724,6 @@ linebuf_reset(struct linebuf *line)
 	line->pos = 0;
 	line->len = 0;
 	line->buf[0] = 0;
-	line->update_pos = 0;
 }
 
 static void
@@ -816,6 +934,7 @@ void uline_set_line2_prompt(struct uline_state *s, const char *str)
 			free_line2(s);
 		else
 			s->line2 = calloc(1, sizeof(*s->line2));
+		s->full_update = true;
 	}
 
 	if (!str || (s->line2->prompt && !strcmp(s->line2->prompt, str)))
@@ -829,24 +948,12 @@ void uline_set_line2_prompt(struct uline_state *s, const char *str)
 static void
 __uline_set_line(struct uline_state *s, struct linebuf *line, const char *str, size_t len)
 {
-	size_t i, prev_len = line->len;
-
 	line->len = 0;
-		linebuf_extend(line, len);
-	for (i = 0; i < prev_len && i < len; i++) {
-		if (line->buf[i] != str[i])
-			break;
-	}
-	if (i > prev_len)
-		i--;
-	if (s->utf8) {
-		// move back to the beginning of the utf-8 symbol
-		while (i > 0 && (str[i] & 0xc0) == 0x80)
-			i--;
-	}
-	line->update_pos = i;
+	if (!linebuf_extend(line, len + 1))
+		return;
 
 	memcpy(line->buf, str, len);
+	line->buf[len] = 0;
 	line->len = len;
 	if (line->pos > line->len)
 		line->pos = line->len;
@@ -892,6 +999,7 @@ void uline_set_hint(struct uline_state *s, const char *str, size_t len)
 		fwrite(str, len, 1, s->output);
 		pos_add_string(s, &s->cursor_pos, str, len);
 	}
+	s->hint_shown = len > 0;
 
 	if (s->cursor_pos.y >= (int16_t)s->rows) {
 		if (s->cursor_pos.x > 0)
@@ -904,16 +1012,37 @@ void uline_set_hint(struct uline_state *s, const char *str, size_t len)
 	fflush(s->output);
 }
 
+static ssize_t
+output_write(void *cookie, const char *buf, size_t len)
+{
+	struct uline_state *s = cookie;
+	size_t ret;
+
+	ret = fwrite(buf, 1, len, s->output_stream);
+	fflush(s->output_stream);
+	s->output_bytes += ret;
+
+	return ret ? ret : -1;
+}
+
 void uline_init(struct uline_state *s, const struct uline_cb *cb,
                 int in_fd, FILE *out_stream, bool utf8)
 {
+	static const cookie_io_functions_t output_fns = {
+		.write = output_write,
+	};
 	struct sigaction sa = {
 		.sa_handler = handle_sigwinch,
 	};
 	s->cb = cb;
 	s->utf8 = utf8;
 	s->input = in_fd;
-	s->output = out_stream;
+	s->output_stream = out_stream;
+
+	// buffer all output of an update and count the bytes written
+	s->output = fopencookie(s, "w", output_fns);
+	if (!s->output)
+		s->output = out_stream;
 	s->ioctl_winsize = true;
 	reset_input_state(s);
 
@@ -942,4 +1071,6 @@ void uline_free(struct uline_state *s)
 	free_line2(s);
 	termios_set_orig_mode(s);
 	linebuf_free(&s->line);
+	if (s->output != s->output_stream)
+		fclose(s->output);
 }
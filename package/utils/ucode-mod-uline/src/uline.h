@@ -14,6 +14,11 @@
 
 struct uline_state;
 
+struct pos {
+	int16_t x;
+	int16_t y;
+};
+
 struct linebuf {
 	char *buf;
 	size_t len;
@@ -21,12 +26,14 @@ struct linebuf {
 
 	char *prompt;
 	size_t pos;
-	size_t update_pos;
-};
 
-struct pos {
-	int16_t x;
-	int16_t y;
+	// copy of the text as currently shown on the terminal, used to
+	// redraw only the cells that changed
+	char *shown;
+	size_t shown_len;
+	size_t shown_size;
+	struct pos start;
+	struct pos end;
 };
 
 enum uline_event {
@@ -67,6 +74,8 @@ struct uline_state {
 
 	int input;
 	FILE *output;
+	FILE *output_stream;
+	size_t output_bytes;
 
 	int sigwinch_count;
 
@@ -81,9 +90,9 @@ struct uline_state {
 
 	unsigned int rows, cols;
 	struct pos cursor_pos;
-	struct pos end_pos;
 	bool ioctl_winsize;
 	bool full_update;
+	bool hint_shown;
 	bool stop;
 
 	bool utf8;
@@ -186,11 +186,11 @@ abort:
 
 int do_crypt(FILE *infile, FILE *outfile, ctx_t *ctx)
 {
-    unsigned char inbuf[CRYPT_BUF_SIZE];
-    unsigned char outbuf[CRYPT_BUF_SIZE + MBEDTLS_MAX_BLOCK_LENGTH];
-    size_t inlen, outlen, step;
+    unsigned char *inbuf, *outbuf;
+    size_t inlen, outlen, step, chunk;
     int ret;
 
+    /* mbedtls_cipher_update() takes a single block at a time in ECB mode */
     if (mbedtls_cipher_get_cipher_mode(ctx) == MBEDTLS_MODE_ECB) {
 	step = mbedtls_cipher_get_block_size(ctx);
 	if (step > CRYPT_BUF_SIZE) {
@@ -199,34 +199,56 @@ int do_crypt(FILE *infile, FILE *outfile, ctx_t *ctx)
     } else {
 	step = CRYPT_BUF_SIZE;
     }
+    chunk = CRYPT_BUF_SIZE - CRYPT_BUF_SIZE % step;
+
+    inbuf = malloc(CRYPT_BUF_SIZE);
+    outbuf = malloc(CRYPT_BUF_SIZE + MBEDTLS_MAX_BLOCK_LENGTH);
+    if (!inbuf || !outbuf) {
+	fprintf(stderr, "Error: do_crypt: out of memory.\n");
+	ret = -1;
+	goto out;
+    }
 
     for (;;) {
-	inlen = fread(inbuf, 1, step, infile);
+	size_t len, total = 0;
+
+	inlen = fread(inbuf, 1, chunk, infile);
 	if (inlen <= 0)
 	    break;
-	ret = mbedtls_cipher_update(ctx, inbuf, inlen, outbuf, &outlen);
-	if (ret) {
-	    fprintf(stderr, "Error: mbedtls_cipher_update: %d\n", ret);
-	    return ret;
+	for (size_t pos = 0; pos < inlen; pos += step) {
+	    len = inlen - pos < step ? inlen - pos : step;
+	    ret = mbedtls_cipher_update(ctx, inbuf + pos, len,
+					outbuf + total, &outlen);
+	    if (ret) {
+		fprintf(stderr, "Error: mbedtls_cipher_update: %d\n", ret);
+		goto out;
+	    }
+	    total += outlen;
 	}
-	ret = fwrite(outbuf, 1, outlen, outfile);
-	if (ret != outlen) {
+	ret = fwrite(outbuf, 1, total, outfile);
+	if (ret != total) {
 	    fprintf(stderr, "Error: cipher_update short write.\n");
-	    return ret - outlen;
+	    ret -= total;
+	    goto out;
 	}
     }
     ret = mbedtls_cipher_finish(ctx, outbuf, &outlen);
     if (ret) {
 	fprintf(stderr, "Error: mbedtls_cipher_finish: %d\n", ret);
-	return ret;
+	goto out;
     }
     ret = fwrite(outbuf, 1, outlen, outfile);
     if (ret != outlen) {
 	fprintf(stderr, "Error: cipher_finish short write.\n");
-	return ret - outlen;
+	ret -= outlen;
+	goto out;
     }
+    ret = 0;
 
-    return 0;
+out:
+    free(inbuf);
+    free(outbuf);
+    return ret;
 }
 
 void free_ctx(ctx_t *ctx)
@@ -76,11 +76,18 @@ abort:
 
 int do_crypt(FILE *infile, FILE *outfile, ctx_t *ctx)
 {
-    unsigned char inbuf[CRYPT_BUF_SIZE];
-    unsigned char outbuf[CRYPT_BUF_SIZE + EVP_MAX_BLOCK_LENGTH];
+    unsigned char *inbuf, *outbuf;
     int inlen, outlen;
     int ret;
 
+    inbuf = malloc(CRYPT_BUF_SIZE);
+    outbuf = malloc(CRYPT_BUF_SIZE + EVP_MAX_BLOCK_LENGTH);
+    if (!inbuf || !outbuf) {
+	fprintf(stderr, "Error: do_crypt: out of memory.\n");
+	ret = -1;
+	goto out;
+    }
+
     for (;;) {
 	inlen = fread(inbuf, 1, CRYPT_BUF_SIZE, infile);
 	if (inlen <= 0)
@@ -88,26 +95,32 @@ int do_crypt(FILE *infile, FILE *outfile, ctx_t *ctx)
 	ret = EVP_CipherUpdate(ctx, outbuf, &outlen, inbuf, inlen);
 	if (!ret) {
 	    fprintf(stderr, "Error: EVP_CipherUpdate: %d\n", ret);
-	    return ret;
+	    goto out;
 	}
 	ret = fwrite(outbuf, 1, outlen, outfile);
 	if (ret != outlen) {
 	    fprintf(stderr, "Error: CipherUpdate short write.\n");
-	    return ret - outlen;
+	    ret -= outlen;
+	    goto out;
 	}
     }
     ret = EVP_CipherFinal_ex(ctx, outbuf, &outlen);
     if (!ret) {
 	fprintf(stderr, "Error: EVP_CipherFinal: %d\n", ret);
-	return ret;
+	goto out;
     }
     ret = fwrite(outbuf, 1, outlen, outfile);
     if (ret != outlen) {
 	fprintf(stderr, "Error: CipherFinal short write.\n");
-	return ret - outlen;
+	ret -= outlen;
+	goto out;
     }
+    ret = 0;
 
-    return 0;
+out:
+    free(inbuf);
+    free(outbuf);
+    return ret;
 }
 
 void free_ctx(ctx_t *ctx)
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "uencrypt.h"
@@ -21,7 +22,11 @@ static void check_enc_dec(const int enc)
 static void show_usage(const char* name)
 {
     fprintf(stderr, "Usage: %s: [-d | -e] [-n] -k key [-i iv] [-c cipher]\n"
-		    "-d = decrypt; -e = encrypt; -n = no padding\n", name);
+		    "       %s: -b MiB [-n] [-k key] [-i iv] [-c cipher]\n"
+		    "-d = decrypt; -e = encrypt; -n = no padding\n"
+		    "-b = benchmark: encrypt and decrypt MiB of data in memory,\n"
+		    "     verify the round trip and print the throughput\n",
+		    name, name);
 }
 
 static void uencrypt_clear_free(void *ptr, size_t len)
@@ -32,6 +37,90 @@ static void uencrypt_clear_free(void *ptr, size_t len)
     }
 }
 
+static double crypt_mem(ctx_t *ctx, unsigned char *in, size_t inlen,
+			unsigned char *out, size_t outsize, size_t *outlen)
+{
+    struct timespec start, end;
+    FILE *infile, *outfile;
+    int ret;
+
+    infile = fmemopen(in, inlen, "r");
+    /* one spare byte for the NUL written by fmemopen in "w" mode */
+    outfile = fmemopen(out, outsize + 1, "w");
+    if (!infile || !outfile) {
+	fprintf(stderr, "Error: fmemopen: %s\n", strerror(errno));
+	ret = -1;
+	goto out;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = do_crypt(infile, outfile, ctx);
+    fflush(outfile);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *outlen = ftell(outfile);
+
+out:
+    if (infile)
+	fclose(infile);
+    if (outfile)
+	fclose(outfile);
+    if (ret)
+	return -1;
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int benchmark(const cipher_t *cipher, const unsigned char *key,
+		     const unsigned char *iv, int padding, size_t mib)
+{
+    size_t len = mib << 20, bufsize = len + CRYPT_BUF_SIZE;
+    size_t enclen, declen;
+    unsigned char *plain, *enc, *dec;
+    double secs[2] = { -1, -1 };
+    ctx_t *ctx;
+    int ret = EXIT_FAILURE;
+
+    plain = malloc(len);
+    enc = malloc(bufsize + 1);
+    dec = malloc(bufsize + 1);
+    if (!plain || !enc || !dec) {
+	fprintf(stderr, "Error: benchmark: out of memory.\n");
+	goto out;
+    }
+    for (size_t i = 0; i < len; i++)
+	plain[i] = i * 131 + (i >> 12);
+
+    if ((ctx = create_ctx(cipher, key, iv, 1, padding))) {
+	secs[0] = crypt_mem(ctx, plain, len, enc, bufsize, &enclen);
+	free_ctx(ctx);
+    }
+    if (secs[0] < 0)
+	goto out;
+
+    if ((ctx = create_ctx(cipher, key, iv, 0, padding))) {
+	secs[1] = crypt_mem(ctx, enc, enclen, dec, bufsize, &declen);
+	free_ctx(ctx);
+    }
+    if (secs[1] < 0)
+	goto out;
+
+    if (declen != len || memcmp(plain, dec, len)) {
+	fprintf(stderr, "Error: decrypted data does not match the input.\n");
+	goto out;
+    }
+
+    printf("encrypt: %zu MiB in %.3f s, %.1f MiB/s\n", mib, secs[0],
+	   mib / secs[0]);
+    printf("decrypt: %zu MiB in %.3f s, %.1f MiB/s\n", mib, secs[1],
+	   mib / secs[1]);
+    ret = EXIT_SUCCESS;
+
+out:
+    free(plain);
+    free(enc);
+    free(dec);
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
     int enc = -1;
@@ -43,9 +132,19 @@ int main(int argc, char *argv[])
     const cipher_t *cipher = get_default_cipher();
     ctx_t* ctx;
     int ret = EXIT_FAILURE;
+    long bench = 0;
+    char *end;
 
-    while ((opt = getopt(argc, argv, "c:dei:k:n")) != -1) {
+    while ((opt = getopt(argc, argv, "b:c:dei:k:n")) != -1) {
 	switch (opt) {
+	case 'b':
+	    bench = strtol(optarg, &end, 10);
+	    if (*end || bench <= 0 || bench > 1024) {
+		fprintf(stderr, "Error: invalid benchmark size: %s MiB.\n",
+			optarg);
+		exit(EINVAL);
+	    }
+	    break;
 	case 'c':
 	    if (!(cipher = get_cipher_or_print_error(optarg)))
 		exit(EXIT_FAILURE);
@@ -84,6 +183,13 @@ int main(int argc, char *argv[])
 	    exit(EINVAL);
 	}
     }
+    if (bench) {
+	/* the key does not matter for the throughput, default to zeroes */
+	if (!key && (keylen = get_cipher_keysize(cipher)))
+	    key = calloc(1, keylen);
+	if (!iv && (ivlen = get_cipher_ivsize(cipher)))
+	    iv = calloc(1, ivlen);
+    }
     if (ivlen != get_cipher_ivsize(cipher)) {
 	fprintf(stderr, "Error: IV must be %d bytes; given IV is %ld bytes.\n",
 		get_cipher_ivsize(cipher), ivlen);
@@ -94,10 +200,14 @@ int main(int argc, char *argv[])
 		get_cipher_keysize(cipher), keylen);
 	exit(EXIT_FAILURE);
     }
-    ctx = create_ctx(cipher, key, iv, !!enc, padding);
-    if (ctx) {
-	ret = do_crypt(stdin, stdout, ctx);
-	free_ctx(ctx);
+    if (bench) {
+	ret = benchmark(cipher, key, iv, padding, bench);
+    } else {
+	ctx = create_ctx(cipher, key, iv, !!enc, padding);
+	if (ctx) {
+	    ret = do_crypt(stdin, stdout, ctx);
+	    free_ctx(ctx);
+	}
     }
     uencrypt_clear_free(iv, ivlen);
     uencrypt_clear_free(key, keylen);
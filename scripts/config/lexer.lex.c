@@ -2331,6 +2331,7 @@ static void alloc_string(const char *str, int size)
 
 static void warn_ignored_character(char chr)
 {
+	parsecache_disable();
 	fprintf(stderr,
 	        "%s:%d:warning: ignoring unsupported character '%c'\n",
 	        current_file->name, yylineno, chr);
@@ -2849,6 +2850,7 @@ case 59:
 /* rule 59 can match eol */
 YY_RULE_SETUP
 {
+		parsecache_disable();
 		fprintf(stderr,
 			"%s:%d:warning: multi-line strings not supported\n",
 			zconf_curname(), zconf_lineno());
@@ -2937,9 +2939,11 @@ case YY_STATE_EOF(ASSIGN_VAL):
 {
 	BEGIN(INITIAL);
 
-	if (prev_token != T_EOL && prev_token != T_HELPTEXT)
+	if (prev_token != T_EOL && prev_token != T_HELPTEXT) {
+		parsecache_disable();
 		fprintf(stderr, "%s:%d:warning: no new line at end of file\n",
 			current_file->name, yylineno);
+	}
 
 	if (current_file) {
 		zconf_endfile();
@@ -4122,30 +4126,42 @@ static void __zconf_nextfile(const char *name)
 	current_file = file;
 }
 
-void zconf_nextfile(const char *name)
+/*
+ * Expand the file name of a source statement. Relative names that do not
+ * match are also tried relative to the directory of @curname.
+ */
+int zconf_glob(const char *name, const char *curname, glob_t *gl)
 {
-	glob_t gl;
 	int err;
-	int i;
 	char path[PATH_MAX], *p;
 
-	err = glob(name, GLOB_ERR | GLOB_MARK, NULL, &gl);
+	err = glob(name, GLOB_ERR | GLOB_MARK, NULL, gl);
 
 	/* ignore wildcard patterns that return no result */
 	if (err == GLOB_NOMATCH && strchr(name, '*')) {
 		err = 0;
-		gl.gl_pathc = 0;
+		gl->gl_pathc = 0;
 	}
 
 	if (err == GLOB_NOMATCH) {
-		p = strdup(current_file->name);
+		p = strdup(curname);
 		if (p) {
 			snprintf(path, sizeof(path), "%s/%s", dirname(p), name);
-			err = glob(path, GLOB_ERR | GLOB_MARK, NULL, &gl);
+			err = glob(path, GLOB_ERR | GLOB_MARK, NULL, gl);
 			free(p);
 		}
 	}
 
+	return err;
+}
+
+void zconf_nextfile(const char *name)
+{
+	glob_t gl;
+	int err;
+	int i;
+
+	err = zconf_glob(name, current_file->name, &gl);
 	if (err) {
 		const char *reason = "unknown error";
 
@@ -4169,6 +4185,7 @@ void zconf_nextfile(const char *name)
 		exit(1);
 	}
 
+	parsecache_add_glob(name, current_file->name, &gl);
 	for (i = 0; i < gl.gl_pathc; i++)
 		__zconf_nextfile(gl.gl_pathv[i]);
 }
@@ -7,6 +7,7 @@
 #define LKC_H
 
 #include <assert.h>
+#include <glob.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -34,6 +35,7 @@ extern int yylineno;
 void zconfdump(FILE *out);
 void zconf_starthelp(void);
 FILE *zconf_fopen(const char *name);
+int zconf_glob(const char *name, const char *curname, glob_t *gl);
 void zconf_initscan(const char *name);
 void zconf_nextfile(const char *name);
 int zconf_lineno(void);
@@ -53,6 +55,14 @@ static inline void xfwrite(const void *str, size_t len, size_t count, FILE *out)
 		fprintf(stderr, "Error in writing or end of file.\n");
 }
 
+/* parsecache.c */
+bool parsecache_load(const char *name);
+void parsecache_save(const char *name);
+void parsecache_disable(void);
+void parsecache_add_env(const char *name, const char *value);
+void parsecache_add_shell(const char *cmd, const char *output);
+void parsecache_add_glob(const char *pattern, const char *curname, glob_t *gl);
+
 /* util.c */
 struct file *file_lookup(const char *name);
 void *xmalloc(size_t size);
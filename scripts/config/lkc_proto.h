@@ -36,6 +36,18 @@ const char * sym_get_string_value(struct symbol *sym);
 
 const char * prop_get_type_name(enum prop_type type);
 
+/* search.c */
+struct sym_search;
+
+bool sym_search_is_literal(const char *pattern);
+struct symbol **sym_search_literal(const char *pattern);
+struct sym_search *sym_search_new(void);
+struct symbol **sym_search_update(struct sym_search *s, const char *pattern,
+				  int max);
+void sym_search_free(struct sym_search *s);
+struct symbol **sym_search_ranked(const char *pattern);
+void sym_search_invalidate(void);
+
 /* preprocess.c */
 enum variable_flavor {
 	VAR_SIMPLE,
@@ -43,6 +55,8 @@ enum variable_flavor {
 	VAR_APPEND,
 };
 void env_write_dep(FILE *f, const char *auto_conf_name);
+void env_restore(const char *name, const char *value);
+char *shell_expand(const char *cmd);
 void variable_add(const char *name, const char *value,
 		  enum variable_flavor flavor);
 void variable_all_del(void);
@@ -474,7 +474,7 @@ again:
 	stpart.text = str_get(&sttext);
 	list_add_tail(&stpart.entries, &trail);
 
-	sym_arr = sym_re_search(dialog_input);
+	sym_arr = sym_search_ranked(dialog_input);
 	do {
 		LIST_HEAD(head);
 		struct search_data data = {
@@ -22,6 +22,7 @@ struct file *current_file;
 void menu_warn(struct menu *menu, const char *fmt, ...)
 {
 	va_list ap;
+	parsecache_disable();
 	va_start(ap, fmt);
 	fprintf(stderr, "%s:%d:warning: ", menu->file->name, menu->lineno);
 	vfprintf(stderr, fmt, ap);
@@ -32,6 +33,7 @@ void menu_warn(struct menu *menu, const char *fmt, ...)
 static void prop_warn(struct property *prop, const char *fmt, ...)
 {
 	va_list ap;
+	parsecache_disable();
 	va_start(ap, fmt);
 	fprintf(stderr, "%s:%d:warning: ", prop->file->name, prop->lineno);
 	vfprintf(stderr, fmt, ap);
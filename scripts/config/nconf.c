@@ -781,7 +781,7 @@ again:
 	if (strncasecmp(dialog_input_result, CONFIG_, strlen(CONFIG_)) == 0)
 		dialog_input += strlen(CONFIG_);
 
-	sym_arr = sym_re_search(dialog_input);
+	sym_arr = sym_search_ranked(dialog_input);
 
 	do {
 		LIST_HEAD(head);
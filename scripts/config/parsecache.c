@@ -0,0 +1,924 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Parse tree cache
+ *
+ * If KCONFIG_PARSE_CACHE names a file, conf_parse() stores the finalized
+ * symbols, properties, menus and expressions in it, along with everything
+ * the parse depended on: the content of all sourced files, the referenced
+ * environment variables, the output of $(shell,...) calls and the files
+ * matched by wildcard source statements. The next run loads the graph from
+ * the cache instead of parsing, as long as none of these changed.
+ *
+ * Parses that printed warnings are not cached, so that the warnings are
+ * shown again on the next run.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lkc.h"
+
+#define PARSECACHE_MAGIC	0x4b435043	/* "KCPC" */
+#define PARSECACHE_VERSION	1
+
+/* symbol references, hashed symbols follow the constants */
+enum {
+	REF_NULL,
+	REF_YES,
+	REF_MOD,
+	REF_NO,
+	REF_SYM,
+};
+
+/* something the parse result depends on, other than file contents */
+struct dep {
+	struct dep *next;
+	char *key;
+	char *arg;
+	char *value;
+};
+
+static struct dep *env_deps, *shell_deps, *glob_deps;
+static bool disabled;
+
+struct wbuf {
+	char *data;
+	size_t len, size;
+};
+
+struct rbuf {
+	char *data;
+	size_t pos, len;
+	bool err;
+};
+
+/* pointer -> index map, also used to collect the objects of one type */
+struct ptr_map {
+	const void **keys;
+	uint32_t *vals;
+	size_t size, used;
+};
+
+struct ptr_list {
+	void **items;
+	uint32_t n, size;
+};
+
+void parsecache_disable(void)
+{
+	disabled = true;
+}
+
+static struct dep **dep_find(struct dep **list, const char *key,
+			     const char *arg)
+{
+	for (; *list; list = &(*list)->next) {
+		if (!strcmp((*list)->key, key) &&
+		    !strcmp((*list)->arg ?: "", arg ?: ""))
+			break;
+	}
+
+	return list;
+}
+
+static void dep_add(struct dep **list, const char *key, const char *arg,
+		    const char *value)
+{
+	struct dep *dep;
+
+	list = dep_find(list, key, arg);
+	if (*list)
+		return;
+
+	dep = xcalloc(1, sizeof(*dep));
+	dep->key = xstrdup(key);
+	dep->arg = arg ? xstrdup(arg) : NULL;
+	dep->value = value ? xstrdup(value) : NULL;
+	*list = dep;
+}
+
+/* @value is NULL if the variable is not set */
+void parsecache_add_env(const char *name, const char *value)
+{
+	dep_add(&env_deps, name, NULL, value);
+}
+
+void parsecache_add_shell(const char *cmd, const char *output)
+{
+	dep_add(&shell_deps, cmd, NULL, output);
+}
+
+static char *glob_join(glob_t *gl)
+{
+	struct gstr gs = str_new();
+	size_t i;
+
+	for (i = 0; i < gl->gl_pathc; i++) {
+		str_append(&gs, gl->gl_pathv[i]);
+		str_append(&gs, "\n");
+	}
+
+	return str_get(&gs);
+}
+
+void parsecache_add_glob(const char *pattern, const char *curname, glob_t *gl)
+{
+	char *files;
+
+	if (!strpbrk(pattern, "*?["))
+		return;
+
+	files = glob_join(gl);
+	dep_add(&glob_deps, pattern, curname, files);
+	free(files);
+}
+
+static uint64_t file_hash(const char *name, uint64_t *size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	char buf[65536];
+	size_t i, len;
+	FILE *f;
+
+	*size = 0;
+	f = zconf_fopen(name);
+	if (!f)
+		return 0;
+
+	while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+		for (i = 0; i < len; i++)
+			hash = (hash ^ (unsigned char)buf[i]) * 0x100000001b3ULL;
+		*size += len;
+	}
+	fclose(f);
+
+	return hash;
+}
+
+static bool ptr_map_lookup(struct ptr_map *map, const void *p, uint32_t *val)
+{
+	size_t i;
+
+	if (!map->size)
+		return false;
+
+	i = ((uintptr_t)p >> 4) * 0x9e3779b97f4a7c15ULL;
+	for (i &= map->size - 1; map->keys[i]; i = (i + 1) & (map->size - 1)) {
+		if (map->keys[i] == p) {
+			*val = map->vals[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void ptr_map_insert(struct ptr_map *map, const void *p, uint32_t val)
+{
+	size_t i;
+
+	if (2 * (map->used + 1) > map->size) {
+		struct ptr_map new = {
+			.size = map->size ? 2 * map->size : 4096,
+		};
+
+		new.keys = xcalloc(new.size, sizeof(*new.keys));
+		new.vals = xcalloc(new.size, sizeof(*new.vals));
+		for (i = 0; i < map->size; i++) {
+			if (map->keys[i])
+				ptr_map_insert(&new, map->keys[i], map->vals[i]);
+		}
+		free(map->keys);
+		free(map->vals);
+		*map = new;
+	}
+
+	i = ((uintptr_t)p >> 4) * 0x9e3779b97f4a7c15ULL;
+	for (i &= map->size - 1; map->keys[i]; i = (i + 1) & (map->size - 1))
+		;
+	map->keys[i] = p;
+	map->vals[i] = val;
+	map->used++;
+}
+
+/* add @p to @list unless already known, returns true if it was added */
+static bool collect(struct ptr_map *map, struct ptr_list *list, void *p)
+{
+	uint32_t val;
+
+	if (!p || ptr_map_lookup(map, p, &val))
+		return false;
+
+	if (list->n == list->size) {
+		list->size = list->size ? 2 * list->size : 1024;
+		list->items = xrealloc(list->items,
+				       list->size * sizeof(*list->items));
+	}
+	list->items[list->n] = p;
+	ptr_map_insert(map, p, ++list->n);
+
+	return true;
+}
+
+static void collect_expr(struct ptr_map *map, struct ptr_list *list,
+			 struct expr *e)
+{
+	if (!collect(map, list, e))
+		return;
+
+	switch (e->type) {
+	case E_OR:
+	case E_AND:
+		collect_expr(map, list, e->right.expr);
+		/* fall through */
+	case E_NOT:
+	case E_LIST:
+		collect_expr(map, list, e->left.expr);
+		break;
+	default:
+		break;
+	}
+}
+
+static struct menu *menu_walk(struct menu *menu)
+{
+	if (menu->list)
+		return menu->list;
+	while (!menu->next && menu->parent)
+		menu = menu->parent;
+
+	return menu->next;
+}
+
+static void w_data(struct wbuf *b, const void *p, size_t len)
+{
+	if (b->len + len > b->size) {
+		b->size = 2 * (b->len + len);
+		b->data = xrealloc(b->data, b->size);
+	}
+	memcpy(b->data + b->len, p, len);
+	b->len += len;
+}
+
+static void w_u32(struct wbuf *b, uint32_t val)
+{
+	w_data(b, &val, sizeof(val));
+}
+
+static void w_u64(struct wbuf *b, uint64_t val)
+{
+	w_data(b, &val, sizeof(val));
+}
+
+/* strings are stored with their terminating zero, length 0 is NULL */
+static void w_str(struct wbuf *b, const char *s)
+{
+	size_t len = s ? strlen(s) + 1 : 0;
+
+	w_u32(b, len);
+	if (len)
+		w_data(b, s, len);
+}
+
+/* object references are the 1-based index, 0 is NULL */
+static void w_ref(struct wbuf *b, struct ptr_map *map, const void *p,
+		  bool *err)
+{
+	uint32_t val = 0;
+
+	if (p && !ptr_map_lookup(map, p, &val))
+		*err = true;
+	w_u32(b, val);
+}
+
+static void w_sym(struct wbuf *b, struct ptr_map *map, struct symbol *sym,
+		  bool *err)
+{
+	uint32_t val = REF_NULL;
+
+	if (sym == &symbol_yes)
+		val = REF_YES;
+	else if (sym == &symbol_mod)
+		val = REF_MOD;
+	else if (sym == &symbol_no)
+		val = REF_NO;
+	else if (sym && ptr_map_lookup(map, sym, &val))
+		val += REF_SYM - 1;
+	else if (sym)
+		*err = true;
+	w_u32(b, val);
+}
+
+static void w_deps(struct wbuf *b, struct dep *list)
+{
+	struct dep *dep;
+	uint32_t n = 0;
+
+	for (dep = list; dep; dep = dep->next)
+		n++;
+
+	w_u32(b, n);
+	for (dep = list; dep; dep = dep->next) {
+		w_str(b, dep->key);
+		w_str(b, dep->arg);
+		w_str(b, dep->value);
+	}
+}
+
+static void w_expr(struct wbuf *b, struct ptr_map *map, struct expr *e,
+		   bool *err)
+{
+	w_u32(b, e->type);
+	switch (e->type) {
+	case E_OR:
+	case E_AND:
+		w_ref(b, map, e->left.expr, err);
+		w_ref(b, map, e->right.expr, err);
+		break;
+	case E_NOT:
+		w_ref(b, map, e->left.expr, err);
+		w_u32(b, 0);
+		break;
+	case E_LIST:
+		w_ref(b, map, e->left.expr, err);
+		w_sym(b, map, e->right.sym, err);
+		break;
+	case E_SYMBOL:
+		w_sym(b, map, e->left.sym, err);
+		w_u32(b, 0);
+		break;
+	case E_EQUAL:
+	case E_UNEQUAL:
+	case E_LTH:
+	case E_LEQ:
+	case E_GTH:
+	case E_GEQ:
+	case E_RANGE:
+		w_sym(b, map, e->left.sym, err);
+		w_sym(b, map, e->right.sym, err);
+		break;
+	default:
+		*err = true;
+		break;
+	}
+}
+
+static bool sym_has_values(struct symbol *sym)
+{
+	int i;
+
+	for (i = 0; i < S_DEF_COUNT; i++) {
+		if (sym->def[i].val)
+			return true;
+	}
+
+	return sym->curr.val != NULL;
+}
+
+static void w_menu(struct wbuf *b, struct ptr_map *map, struct menu *menu,
+		   bool *err)
+{
+	w_ref(b, map, menu->next, err);
+	w_ref(b, map, menu->parent, err);
+	w_ref(b, map, menu->list, err);
+	w_sym(b, map, menu->sym, err);
+	w_ref(b, map, menu->prompt, err);
+	w_ref(b, map, menu->visibility, err);
+	w_ref(b, map, menu->dep, err);
+	w_u32(b, menu->flags);
+	w_str(b, menu->help);
+	w_ref(b, map, menu->file, err);
+	w_u32(b, menu->lineno);
+	if (menu->data)
+		*err = true;
+}
+
+void parsecache_save(const char *name)
+{
+	const char *path = getenv("KCONFIG_PARSE_CACHE");
+	struct ptr_list files = {}, syms = {}, props = {}, menus = {};
+	struct ptr_list exprs = {};
+	struct ptr_map map = {};
+	struct wbuf b = {};
+	struct property *prop;
+	struct symbol *sym;
+	struct menu *menu;
+	struct file *file;
+	bool err = false;
+	char tmp[PATH_MAX];
+	uint64_t hash, size;
+	uint32_t i;
+	FILE *f;
+
+	if (!path || !*path || disabled)
+		return;
+
+	for (file = file_list; file; file = file->next)
+		collect(&map, &files, file);
+	for_all_symbols(i, sym) {
+		collect(&map, &syms, sym);
+		if (sym_has_values(sym))
+			err = true;
+	}
+	for (menu = &rootmenu; menu; menu = menu_walk(menu))
+		collect(&map, &menus, menu);
+
+	for (i = 0; i < syms.n; i++) {
+		sym = syms.items[i];
+		for (prop = sym->prop; prop; prop = prop->next)
+			collect(&map, &props, prop);
+		collect_expr(&map, &exprs, sym->dir_dep.expr);
+		collect_expr(&map, &exprs, sym->rev_dep.expr);
+		collect_expr(&map, &exprs, sym->implied.expr);
+	}
+	for (i = 0; i < menus.n; i++) {
+		menu = menus.items[i];
+		collect(&map, &props, menu->prompt);
+		collect_expr(&map, &exprs, menu->visibility);
+		collect_expr(&map, &exprs, menu->dep);
+	}
+	for (i = 0; i < props.n; i++) {
+		prop = props.items[i];
+		collect_expr(&map, &exprs, prop->visible.expr);
+		collect_expr(&map, &exprs, prop->expr);
+	}
+
+	w_u32(&b, PARSECACHE_MAGIC);
+	w_u32(&b, PARSECACHE_VERSION);
+	w_str(&b, name);
+	w_str(&b, getenv(SRCTREE));
+	w_deps(&b, env_deps);
+	w_deps(&b, shell_deps);
+	w_deps(&b, glob_deps);
+
+	w_u32(&b, files.n);
+	for (i = 0; i < files.n; i++) {
+		file = files.items[i];
+		hash = file_hash(file->name, &size);
+		w_str(&b, file->name);
+		w_u64(&b, size);
+		w_u64(&b, hash);
+		w_ref(&b, &map, file->next, &err);
+		w_ref(&b, &map, file->parent, &err);
+		w_u32(&b, file->lineno);
+	}
+
+	w_u32(&b, syms.n);
+	w_u32(&b, props.n);
+	w_u32(&b, menus.n);
+	w_u32(&b, exprs.n);
+
+	for_all_symbols(i, sym) {
+		w_str(&b, sym->name);
+		w_u32(&b, i);
+		w_u32(&b, sym->type);
+		w_u32(&b, sym->curr.tri);
+		w_u32(&b, sym->visible);
+		w_u32(&b, sym->flags);
+		w_ref(&b, &map, sym->prop, &err);
+		w_ref(&b, &map, sym->dir_dep.expr, &err);
+		w_u32(&b, sym->dir_dep.tri);
+		w_ref(&b, &map, sym->rev_dep.expr, &err);
+		w_u32(&b, sym->rev_dep.tri);
+		w_ref(&b, &map, sym->implied.expr, &err);
+		w_u32(&b, sym->implied.tri);
+	}
+
+	for (i = 0; i < props.n; i++) {
+		prop = props.items[i];
+		w_ref(&b, &map, prop->next, &err);
+		w_u32(&b, prop->type);
+		w_str(&b, prop->text);
+		w_ref(&b, &map, prop->visible.expr, &err);
+		w_u32(&b, prop->visible.tri);
+		w_ref(&b, &map, prop->expr, &err);
+		w_ref(&b, &map, prop->menu, &err);
+		w_ref(&b, &map, prop->file, &err);
+		w_u32(&b, prop->lineno);
+	}
+
+	for (i = 0; i < menus.n; i++)
+		w_menu(&b, &map, menus.items[i], &err);
+
+	for (i = 0; i < exprs.n; i++)
+		w_expr(&b, &map, exprs.items[i], &err);
+
+	w_ref(&b, &map, file_list, &err);
+	w_sym(&b, &map, modules_sym, &err);
+
+	/* something in the graph is not covered by the format */
+	if (err)
+		goto out;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	f = fopen(tmp, "w");
+	if (!f)
+		goto out;
+
+	if (fwrite(b.data, 1, b.len, f) != b.len)
+		err = true;
+	if (fclose(f) || err || rename(tmp, path))
+		unlink(tmp);
+
+out:
+	free(b.data);
+	free(map.keys);
+	free(map.vals);
+	free(files.items);
+	free(syms.items);
+	free(props.items);
+	free(menus.items);
+	free(exprs.items);
+}
+
+static const void *r_data(struct rbuf *b, size_t len)
+{
+	const void *p = b->data + b->pos;
+
+	if (b->err || len > b->len - b->pos) {
+		b->err = true;
+		return NULL;
+	}
+	b->pos += len;
+
+	return p;
+}
+
+static uint32_t r_u32(struct rbuf *b)
+{
+	const void *p = r_data(b, sizeof(uint32_t));
+	uint32_t val = 0;
+
+	if (p)
+		memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+static uint64_t r_u64(struct rbuf *b)
+{
+	const void *p = r_data(b, sizeof(uint64_t));
+	uint64_t val = 0;
+
+	if (p)
+		memcpy(&val, p, sizeof(val));
+
+	return val;
+}
+
+/* returns a pointer into the cache buffer, which is kept after loading */
+static char *r_str(struct rbuf *b)
+{
+	uint32_t len = r_u32(b);
+	char *s;
+
+	if (!len)
+		return NULL;
+
+	s = (char *)r_data(b, len);
+	if (s && s[len - 1]) {
+		b->err = true;
+		return NULL;
+	}
+
+	return s;
+}
+
+static bool str_eq(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return !strcmp(a, b);
+}
+
+static void *r_ref(struct rbuf *b, void *base, size_t size, uint32_t n)
+{
+	uint32_t val = r_u32(b);
+
+	if (!val)
+		return NULL;
+	if (val > n) {
+		b->err = true;
+		return NULL;
+	}
+
+	return (char *)base + (val - 1) * size;
+}
+
+static struct symbol *r_sym(struct rbuf *b, struct symbol *syms, uint32_t n)
+{
+	uint32_t val = r_u32(b);
+
+	switch (val) {
+	case REF_NULL:
+		return NULL;
+	case REF_YES:
+		return &symbol_yes;
+	case REF_MOD:
+		return &symbol_mod;
+	case REF_NO:
+		return &symbol_no;
+	}
+
+	val -= REF_SYM;
+	if (val >= n) {
+		b->err = true;
+		return NULL;
+	}
+
+	return &syms[val];
+}
+
+/* the first menu is the root menu, the others are in @menus */
+static struct menu *r_menu(struct rbuf *b, struct menu *menus, uint32_t n)
+{
+	uint32_t val = r_u32(b);
+
+	if (!val)
+		return NULL;
+	if (val > n) {
+		b->err = true;
+		return NULL;
+	}
+
+	return val == 1 ? &rootmenu : &menus[val - 2];
+}
+
+static bool check_env(struct rbuf *b, struct dep **list)
+{
+	uint32_t i, n = r_u32(b);
+	struct dep *dep;
+	bool ok = true;
+
+	for (i = 0; i < n && !b->err; i++) {
+		dep = xcalloc(1, sizeof(*dep));
+		dep->key = r_str(b);
+		dep->arg = r_str(b);
+		dep->value = r_str(b);
+		dep->next = *list;
+		*list = dep;
+		if (!dep->key || !str_eq(getenv(dep->key), dep->value))
+			ok = false;
+	}
+
+	return ok && !b->err;
+}
+
+static bool check_shell(struct rbuf *b)
+{
+	uint32_t i, n = r_u32(b);
+	const char *cmd, *output;
+	char *res;
+	bool ok = true;
+
+	for (i = 0; i < n && ok && !b->err; i++) {
+		cmd = r_str(b);
+		r_str(b);
+		output = r_str(b);
+		if (!cmd || !output)
+			break;
+
+		res = shell_expand(cmd);
+		ok = !strcmp(res, output);
+		free(res);
+	}
+
+	return ok && !b->err;
+}
+
+static bool check_glob(struct rbuf *b)
+{
+	uint32_t i, n = r_u32(b);
+	const char *pattern, *curname, *files;
+	glob_t gl;
+	char *res;
+	bool ok = true;
+
+	for (i = 0; i < n && ok && !b->err; i++) {
+		pattern = r_str(b);
+		curname = r_str(b);
+		files = r_str(b);
+		if (!pattern || !curname || !files)
+			break;
+
+		if (zconf_glob(pattern, curname, &gl))
+			return false;
+
+		res = glob_join(&gl);
+		ok = !strcmp(res, files);
+		free(res);
+		if (gl.gl_pathc)
+			globfree(&gl);
+	}
+
+	return ok && !b->err;
+}
+
+/* the sourced files are part of the graph as well as dependencies */
+static struct file *read_files(struct rbuf *b, uint32_t *nfiles)
+{
+	uint32_t i, n = r_u32(b);
+	uint64_t hash, size, cur_size;
+	struct file *files, *file;
+
+	*nfiles = n;
+	if (b->err || n > b->len) {
+		b->err = true;
+		return NULL;
+	}
+
+	files = xcalloc(n, sizeof(*files));
+	for (i = 0; i < n && !b->err; i++) {
+		file = &files[i];
+		file->name = r_str(b);
+		size = r_u64(b);
+		hash = r_u64(b);
+		file->next = r_ref(b, files, sizeof(*files), n);
+		file->parent = r_ref(b, files, sizeof(*files), n);
+		file->lineno = r_u32(b);
+		if (!file->name || b->err)
+			break;
+
+		if (file_hash(file->name, &cur_size) != hash || cur_size != size)
+			b->err = true;
+	}
+
+	return files;
+}
+
+/*
+ * Replace the parse of @name with the cached graph if it is still valid.
+ * Returns false, without touching any state, if the cache can not be used.
+ */
+bool parsecache_load(const char *name)
+{
+	const char *path = getenv("KCONFIG_PARSE_CACHE");
+	struct symbol *syms = NULL, *sym, *prev;
+	struct property *props = NULL, *prop;
+	struct menu *menus = NULL, *menu, root;
+	struct expr *exprs = NULL, *e;
+	struct file *files = NULL, *list;
+	struct dep *env = NULL, *dep;
+	uint32_t nfiles, nsyms, nprops, nmenus, nexprs, i;
+	uint32_t *buckets = NULL;
+	struct rbuf b = {};
+	long len;
+	FILE *f;
+
+	if (!path || !*path || file_list)
+		return false;
+	for (i = 0; i < SYMBOL_HASHSIZE; i++) {
+		if (symbol_hash[i])
+			return false;
+	}
+
+	f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	if (!fseek(f, 0, SEEK_END) && (len = ftell(f)) > 0 &&
+	    !fseek(f, 0, SEEK_SET)) {
+		b.len = len;
+		b.data = xmalloc(b.len);
+		if (fread(b.data, 1, b.len, f) != b.len)
+			b.err = true;
+	} else {
+		b.err = true;
+	}
+	fclose(f);
+
+	if (r_u32(&b) != PARSECACHE_MAGIC || r_u32(&b) != PARSECACHE_VERSION ||
+	    !str_eq(r_str(&b), name) || !str_eq(r_str(&b), getenv(SRCTREE)) ||
+	    !check_env(&b, &env) || !check_shell(&b) || !check_glob(&b))
+		goto fail;
+
+	files = read_files(&b, &nfiles);
+	nsyms = r_u32(&b);
+	nprops = r_u32(&b);
+	nmenus = r_u32(&b);
+	nexprs = r_u32(&b);
+	if (b.err || !nmenus || nsyms > b.len || nprops > b.len ||
+	    nmenus > b.len || nexprs > b.len)
+		goto fail;
+
+	syms = xcalloc(nsyms, sizeof(*syms));
+	buckets = xcalloc(nsyms, sizeof(*buckets));
+	props = xcalloc(nprops, sizeof(*props));
+	menus = xcalloc(nmenus - 1, sizeof(*menus));
+	exprs = xcalloc(nexprs, sizeof(*exprs));
+
+	for (i = 0; i < nsyms; i++) {
+		sym = &syms[i];
+		sym->name = r_str(&b);
+		buckets[i] = r_u32(&b);
+		sym->type = r_u32(&b);
+		sym->curr.tri = r_u32(&b);
+		sym->visible = r_u32(&b);
+		sym->flags = r_u32(&b);
+		sym->prop = r_ref(&b, props, sizeof(*props), nprops);
+		sym->dir_dep.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		sym->dir_dep.tri = r_u32(&b);
+		sym->rev_dep.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		sym->rev_dep.tri = r_u32(&b);
+		sym->implied.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		sym->implied.tri = r_u32(&b);
+		if (buckets[i] >= SYMBOL_HASHSIZE ||
+		    (i && buckets[i] < buckets[i - 1]))
+			b.err = true;
+	}
+
+	for (i = 0; i < nprops; i++) {
+		prop = &props[i];
+		prop->next = r_ref(&b, props, sizeof(*props), nprops);
+		prop->type = r_u32(&b);
+		prop->text = r_str(&b);
+		prop->visible.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		prop->visible.tri = r_u32(&b);
+		prop->expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		prop->menu = r_menu(&b, menus, nmenus);
+		prop->file = r_ref(&b, files, sizeof(*files), nfiles);
+		prop->lineno = r_u32(&b);
+	}
+
+	for (i = 0; i < nmenus; i++) {
+		menu = i ? &menus[i - 1] : &root;
+		menu->next = r_menu(&b, menus, nmenus);
+		menu->parent = r_menu(&b, menus, nmenus);
+		menu->list = r_menu(&b, menus, nmenus);
+		menu->sym = r_sym(&b, syms, nsyms);
+		menu->prompt = r_ref(&b, props, sizeof(*props), nprops);
+		menu->visibility = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		menu->dep = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+		menu->flags = r_u32(&b);
+		menu->help = r_str(&b);
+		menu->file = r_ref(&b, files, sizeof(*files), nfiles);
+		menu->lineno = r_u32(&b);
+		menu->data = NULL;
+	}
+
+	for (i = 0; i < nexprs; i++) {
+		e = &exprs[i];
+		e->type = r_u32(&b);
+		switch (e->type) {
+		case E_OR:
+		case E_AND:
+		case E_NOT:
+			e->left.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+			e->right.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+			break;
+		case E_LIST:
+			e->left.expr = r_ref(&b, exprs, sizeof(*exprs), nexprs);
+			e->right.sym = r_sym(&b, syms, nsyms);
+			break;
+		default:
+			e->left.sym = r_sym(&b, syms, nsyms);
+			e->right.sym = r_sym(&b, syms, nsyms);
+			break;
+		}
+	}
+
+	list = r_ref(&b, files, sizeof(*files), nfiles);
+	sym = r_sym(&b, syms, nsyms);
+	if (b.err || b.pos != b.len)
+		goto fail;
+
+	/* everything checked out, install the graph */
+	for (i = 0, prev = NULL; i < nsyms; prev = &syms[i++]) {
+		if (i && buckets[i] == buckets[i - 1])
+			prev->next = &syms[i];
+		else
+			symbol_hash[buckets[i]] = &syms[i];
+	}
+	rootmenu = root;
+	file_list = list;
+	modules_sym = sym;
+	for (dep = env; dep; dep = dep->next) {
+		if (dep->value)
+			env_restore(dep->key, dep->value);
+	}
+	sym_search_invalidate();
+
+	goto out;
+
+fail:
+	free(files);
+	free(syms);
+	free(props);
+	free(menus);
+	free(exprs);
+	free(b.data);
+	b.err = true;
+out:
+	free(buckets);
+	while (env) {
+		dep = env;
+		env = dep->next;
+		free(dep);
+	}
+
+	return !b.err;
+}
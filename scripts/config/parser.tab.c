@@ -1938,6 +1938,11 @@ void conf_parse(const char *name)
 	struct symbol *sym;
 	int i;
 
+	if (parsecache_load(name)) {
+		conf_set_changed(true);
+		return;
+	}
+
 	zconf_initscan(name);
 
 	_menu_init();
@@ -1968,6 +1973,7 @@ void conf_parse(const char *name)
 	}
 	if (yynerrs)
 		exit(1);
+	parsecache_save(name);
 	conf_set_changed(true);
 }
 
@@ -1996,6 +2002,7 @@ static void zconfprint(const char *err, ...)
 {
 	va_list ap;
 
+	parsecache_disable();
 	fprintf(stderr, "%s:%d: ", zconf_curname(), zconf_lineno());
 	va_start(ap, err);
 	vfprintf(stderr, err, ap);
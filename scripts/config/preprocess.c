@@ -75,6 +75,7 @@ static char *env_expand(const char *name)
 	}
 
 	value = getenv(name);
+	parsecache_add_env(name, value);
 	if (!value)
 		return NULL;
 
@@ -99,6 +100,12 @@ void env_write_dep(FILE *f, const char *autoconfig_name)
 	}
 }
 
+/* Called when the parse is replaced by a cached one */
+void env_restore(const char *name, const char *value)
+{
+	env_add(name, value);
+}
+
 /*
  * Built-in functions
  */
@@ -124,6 +131,7 @@ static char *do_filename(int argc, char *argv[])
 
 static char *do_info(int argc, char *argv[])
 {
+	parsecache_disable();
 	printf("%s\n", argv[0]);
 
 	return xstrdup("");
@@ -138,16 +146,13 @@ static char *do_lineno(int argc, char *argv[])
 	return xstrdup(buf);
 }
 
-static char *do_shell(int argc, char *argv[])
+char *shell_expand(const char *cmd)
 {
 	FILE *p;
 	char buf[4096];
-	char *cmd;
 	size_t nread;
 	int i;
 
-	cmd = argv[0];
-
 	p = popen(cmd, "r");
 	if (!p) {
 		perror(cmd);
@@ -178,11 +183,22 @@ static char *do_shell(int argc, char *argv[])
 	return xstrdup(buf);
 }
 
+static char *do_shell(int argc, char *argv[])
+{
+	char *res = shell_expand(argv[0]);
+
+	parsecache_add_shell(argv[0], res);
+
+	return res;
+}
+
 static char *do_warning_if(int argc, char *argv[])
 {
-	if (!strcmp(argv[0], "y"))
+	if (!strcmp(argv[0], "y")) {
+		parsecache_disable();
 		fprintf(stderr, "%s:%d: %s\n",
 			current_file->name, yylineno, argv[1]);
+	}
 
 	return xstrdup("");
 }
@@ -1224,7 +1224,7 @@ void ConfigInfoView::contextMenuEvent(QContextMenuEvent *event)
 }
 
 ConfigSearchWindow::ConfigSearchWindow(ConfigMainWindow *parent)
-	: Parent(parent), result(NULL)
+	: Parent(parent), result(NULL), incSearch(NULL)
 {
 	setObjectName("search");
 	setWindowTitle("Search Config");
@@ -1240,6 +1240,8 @@ ConfigSearchWindow::ConfigSearchWindow(ConfigMainWindow *parent)
 	editField = new QLineEdit(this);
 	connect(editField, &QLineEdit::returnPressed,
 		this, &ConfigSearchWindow::search);
+	connect(editField, &QLineEdit::textChanged,
+		this, &ConfigSearchWindow::searchIncremental);
 	layout2->addWidget(editField);
 	searchButton = new QPushButton("Search", this);
 	searchButton->setAutoDefault(false);
@@ -1280,6 +1282,12 @@ ConfigSearchWindow::ConfigSearchWindow(ConfigMainWindow *parent)
 		this, &ConfigSearchWindow::saveSettings);
 }
 
+ConfigSearchWindow::~ConfigSearchWindow(void)
+{
+	free(result);
+	sym_search_free(incSearch);
+}
+
 void ConfigSearchWindow::saveSettings(void)
 {
 	if (!objectName().isEmpty()) {
@@ -1294,6 +1302,24 @@ void ConfigSearchWindow::saveSettings(void)
 }
 
 void ConfigSearchWindow::search(void)
+{
+	showResult(sym_re_search(editField->text().toLatin1()));
+}
+
+/* search as you type, regular expressions are only run on return */
+void ConfigSearchWindow::searchIncremental(const QString &text)
+{
+	QByteArray pattern = text.toLatin1();
+
+	if (pattern.size() < 2 || !sym_search_is_literal(pattern.constData()))
+		return;
+
+	if (!incSearch)
+		incSearch = sym_search_new();
+	showResult(sym_search_update(incSearch, pattern.constData(), 0));
+}
+
+void ConfigSearchWindow::showResult(struct symbol **sym_arr)
 {
 	struct symbol **p;
 	struct property *prop;
@@ -1303,7 +1329,7 @@ void ConfigSearchWindow::search(void)
 	list->clear();
 	info->clear();
 
-	result = sym_re_search(editField->text().toLatin1());
+	result = sym_arr;
 	if (!result)
 		return;
 	for (p = result; *p; p++) {
@@ -219,12 +219,16 @@ class ConfigSearchWindow : public QDialog {
 	typedef class QDialog Parent;
 public:
 	ConfigSearchWindow(ConfigMainWindow *parent);
+	~ConfigSearchWindow(void);
 
 public slots:
 	void saveSettings(void);
 	void search(void);
+	void searchIncremental(const QString &text);
 
 protected:
+	void showResult(struct symbol **sym_arr);
+
 	QLineEdit* editField;
 	QPushButton* searchButton;
 	QSplitter* split;
@@ -232,6 +236,7 @@ protected:
 	ConfigInfoView* info;
 
 	struct symbol **result;
+	struct sym_search *incSearch;
 };
 
 class ConfigMainWindow : public QMainWindow {
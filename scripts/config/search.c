@@ -0,0 +1,474 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Symbol search index
+ *
+ * Literal searches (optionally anchored with ^ and $) are answered from a
+ * trigram index over the symbol names and prompts, which is built on the
+ * first search after parsing. Only patterns using other regex features
+ * have to fall back to running regexec() over every symbol.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lkc.h"
+
+struct search_entry {
+	struct symbol *sym;
+	/* upper case copies */
+	char *name;
+	char *prompt;
+	size_t name_len;
+};
+
+struct search_query {
+	char *text;
+	size_t len;
+	bool head, tail;
+};
+
+struct sym_search {
+	struct search_query query;
+	int *ids;
+	int n_ids;
+	int gen;
+};
+
+enum {
+	MATCH_NONE,
+	MATCH_EXACT,
+	MATCH_PREFIX,
+	MATCH_NAME,
+	MATCH_PROMPT,
+};
+
+struct search_match {
+	int id;
+	int rank;
+};
+
+static struct search_entry *entries;
+static int n_entries;
+static bool index_valid;
+/* bumped on every rebuild, entry ids of older builds are meaningless */
+static int index_gen;
+
+/* posting lists of entry ids, stored back to back and sorted by trigram */
+static unsigned int *tri_keys;
+static int *tri_start;
+static int *tri_ids;
+static int n_keys;
+
+struct tri_pair {
+	unsigned int key;
+	int id;
+};
+
+#define SEARCH_META	".[]()*+?{}|\\^$"
+
+static unsigned int trigram(const char *s)
+{
+	return (unsigned char)s[0] << 16 | (unsigned char)s[1] << 8 |
+	       (unsigned char)s[2];
+}
+
+static char *upper_dup(const char *s)
+{
+	char *p, *ret = xstrdup(s);
+
+	for (p = ret; *p; p++)
+		*p = toupper((unsigned char)*p);
+
+	return ret;
+}
+
+static int tri_pair_cmp(const void *p1, const void *p2)
+{
+	const struct tri_pair *t1 = p1, *t2 = p2;
+
+	if (t1->key != t2->key)
+		return t1->key < t2->key ? -1 : 1;
+
+	return t1->id - t2->id;
+}
+
+static void add_trigrams(struct tri_pair **pairs, int *cnt, int *size,
+			 const char *s, int id)
+{
+	size_t i, len = strlen(s);
+
+	for (i = 0; i + 3 <= len; i++) {
+		if (*cnt >= *size) {
+			*size = *size ? *size * 2 : 4096;
+			*pairs = xrealloc(*pairs, *size * sizeof(**pairs));
+		}
+		(*pairs)[*cnt].key = trigram(s + i);
+		(*pairs)[(*cnt)++].id = id;
+	}
+}
+
+static void search_index_free(void)
+{
+	int i;
+
+	for (i = 0; i < n_entries; i++) {
+		free(entries[i].name);
+		free(entries[i].prompt);
+	}
+	free(entries);
+	free(tri_keys);
+	free(tri_start);
+	free(tri_ids);
+	entries = NULL;
+	tri_keys = NULL;
+	tri_start = NULL;
+	tri_ids = NULL;
+	n_entries = n_keys = 0;
+}
+
+static void search_index_build(void)
+{
+	struct tri_pair *pairs = NULL;
+	struct property *prop;
+	struct symbol *sym;
+	int i, j, cnt = 0, size = 0;
+
+	search_index_free();
+
+	for_all_symbols(i, sym) {
+		if (sym->flags & SYMBOL_CONST || !sym->name)
+			continue;
+		n_entries++;
+	}
+	entries = xcalloc(n_entries ? n_entries : 1, sizeof(*entries));
+
+	j = 0;
+	for_all_symbols(i, sym) {
+		struct search_entry *e;
+
+		if (sym->flags & SYMBOL_CONST || !sym->name)
+			continue;
+
+		e = &entries[j];
+		e->sym = sym;
+		e->name = upper_dup(sym->name);
+		e->name_len = strlen(e->name);
+		for_all_prompts(sym, prop) {
+			e->prompt = upper_dup(prop->text);
+			break;
+		}
+
+		add_trigrams(&pairs, &cnt, &size, e->name, j);
+		if (e->prompt)
+			add_trigrams(&pairs, &cnt, &size, e->prompt, j);
+		j++;
+	}
+
+	qsort(pairs, cnt, sizeof(*pairs), tri_pair_cmp);
+
+	tri_keys = xmalloc((cnt + 1) * sizeof(*tri_keys));
+	tri_start = xmalloc((cnt + 1) * sizeof(*tri_start));
+	tri_ids = xmalloc((cnt + 1) * sizeof(*tri_ids));
+	for (i = 0, j = 0; i < cnt; i++) {
+		if (i && pairs[i].key == pairs[i - 1].key &&
+		    pairs[i].id == pairs[i - 1].id)
+			continue;
+		if (!i || pairs[i].key != pairs[i - 1].key) {
+			tri_keys[n_keys] = pairs[i].key;
+			tri_start[n_keys++] = j;
+		}
+		tri_ids[j++] = pairs[i].id;
+	}
+	tri_start[n_keys] = j;
+	free(pairs);
+
+	index_valid = true;
+	index_gen++;
+}
+
+/* called when a new symbol is added after the index has been built */
+void sym_search_invalidate(void)
+{
+	index_valid = false;
+}
+
+static int *tri_lookup(unsigned int key, int *cnt)
+{
+	int lo = 0, hi = n_keys;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (tri_keys[mid] == key) {
+			*cnt = tri_start[mid + 1] - tri_start[mid];
+			return &tri_ids[tri_start[mid]];
+		}
+		if (tri_keys[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*cnt = 0;
+	return NULL;
+}
+
+bool sym_search_is_literal(const char *pattern)
+{
+	size_t len = strlen(pattern);
+
+	if (*pattern == '^') {
+		pattern++;
+		len--;
+	}
+	if (len && pattern[len - 1] == '$' &&
+	    (len < 2 || pattern[len - 2] != '\\'))
+		len--;
+
+	return strcspn(pattern, SEARCH_META) >= len;
+}
+
+static void query_parse(struct search_query *q, const char *pattern)
+{
+	free(q->text);
+	q->head = *pattern == '^';
+	if (q->head)
+		pattern++;
+	q->text = upper_dup(pattern);
+	q->len = strlen(q->text);
+	q->tail = q->len && q->text[q->len - 1] == '$';
+	if (q->tail)
+		q->text[--q->len] = 0;
+}
+
+/* true if everything matching @q also matches @prev */
+static bool query_narrows(const struct search_query *prev,
+			  const struct search_query *q)
+{
+	if (prev->head && (!q->head || strncmp(q->text, prev->text, prev->len)))
+		return false;
+	if (prev->tail && (!q->tail || q->len < prev->len ||
+			   strcmp(q->text + q->len - prev->len, prev->text)))
+		return false;
+
+	return strstr(q->text, prev->text) != NULL;
+}
+
+static int entry_match(const struct search_entry *e,
+		       const struct search_query *q, bool prompts)
+{
+	const char *s;
+
+	if (q->head && q->tail)
+		return strcmp(e->name, q->text) ? MATCH_NONE : MATCH_EXACT;
+
+	if (q->head)
+		return strncmp(e->name, q->text, q->len) ?
+		       MATCH_NONE : e->name_len == q->len ?
+		       MATCH_EXACT : MATCH_PREFIX;
+
+	if (q->tail) {
+		if (e->name_len < q->len ||
+		    strcmp(e->name + e->name_len - q->len, q->text))
+			return MATCH_NONE;
+		return e->name_len == q->len ? MATCH_EXACT : MATCH_NAME;
+	}
+
+	s = strstr(e->name, q->text);
+	if (s == e->name)
+		return e->name_len == q->len ? MATCH_EXACT : MATCH_PREFIX;
+	if (s)
+		return MATCH_NAME;
+
+	if (prompts && e->prompt && strstr(e->prompt, q->text))
+		return MATCH_PROMPT;
+
+	return MATCH_NONE;
+}
+
+/* entry ids that may match @q, in ascending order */
+static int *candidates(const struct search_query *q, int *cnt)
+{
+	int *best = NULL, *ids;
+	int i, n, best_cnt;
+
+	if (!index_valid)
+		search_index_build();
+
+	best_cnt = n_entries;
+
+	if (q->len >= 3) {
+		for (i = 0; i + 3 <= q->len; i++) {
+			ids = tri_lookup(trigram(q->text + i), &n);
+			if (!ids) {
+				*cnt = 0;
+				return NULL;
+			}
+			if (n < best_cnt || !best) {
+				best = ids;
+				best_cnt = n;
+			}
+		}
+	}
+
+	ids = xmalloc((best_cnt ? best_cnt : 1) * sizeof(*ids));
+	for (i = 0; i < best_cnt; i++)
+		ids[i] = best ? best[i] : i;
+	*cnt = best_cnt;
+
+	return ids;
+}
+
+static int match_cmp(const void *p1, const void *p2)
+{
+	const struct search_match *m1 = p1, *m2 = p2;
+
+	if (m1->rank != m2->rank)
+		return m1->rank - m2->rank;
+
+	return strcmp(entries[m1->id].sym->name, entries[m2->id].sym->name);
+}
+
+static struct symbol **match_result(struct search_match *m, int cnt, int max)
+{
+	struct symbol **sym_arr;
+	int i;
+
+	if (!cnt)
+		return NULL;
+
+	qsort(m, cnt, sizeof(*m), match_cmp);
+	if (max > 0 && cnt > max)
+		cnt = max;
+
+	sym_arr = xmalloc((cnt + 1) * sizeof(*sym_arr));
+	for (i = 0; i < cnt; i++) {
+		sym_arr[i] = entries[m[i].id].sym;
+		sym_calc_value(sym_arr[i]);
+	}
+	sym_arr[cnt] = NULL;
+
+	return sym_arr;
+}
+
+/*
+ * Search symbol names for a literal pattern, with the same result and
+ * order as sym_re_search(): exact matches first, then alphabetical.
+ */
+struct symbol **sym_search_literal(const char *pattern)
+{
+	struct search_query q = {};
+	struct search_match *m;
+	struct symbol **sym_arr;
+	int *ids, i, n, cnt = 0;
+
+	query_parse(&q, pattern);
+	ids = candidates(&q, &n);
+	m = xmalloc((n ? n : 1) * sizeof(*m));
+	for (i = 0; i < n; i++) {
+		int rank = entry_match(&entries[ids[i]], &q, false);
+
+		if (rank == MATCH_NONE)
+			continue;
+		m[cnt].id = ids[i];
+		m[cnt++].rank = rank == MATCH_EXACT ? 0 : 1;
+	}
+
+	sym_arr = match_result(m, cnt, 0);
+	free(m);
+	free(ids);
+	free(q.text);
+
+	return sym_arr;
+}
+
+struct sym_search *sym_search_new(void)
+{
+	return xcalloc(1, sizeof(struct sym_search));
+}
+
+void sym_search_free(struct sym_search *s)
+{
+	if (!s)
+		return;
+
+	free(s->query.text);
+	free(s->ids);
+	free(s);
+}
+
+/*
+ * Incremental, ranked search for a literal pattern in symbol names and
+ * prompts. Ranking is exact name match, name prefix, name substring and
+ * prompt substring, each group sorted alphabetically. If the pattern
+ * narrows down the previous one (e.g. while typing), only the previous
+ * matches are checked again. At most @max symbols are returned if @max
+ * is positive.
+ */
+struct symbol **sym_search_update(struct sym_search *s, const char *pattern,
+				  int max)
+{
+	struct search_query q = {};
+	struct search_match *m;
+	struct symbol **sym_arr;
+	int *ids, i, n, cnt = 0;
+
+	query_parse(&q, pattern);
+	if (!q.len) {
+		free(q.text);
+		return NULL;
+	}
+
+	if (s->gen == index_gen && index_valid && s->query.text &&
+	    query_narrows(&s->query, &q)) {
+		ids = s->ids;
+		n = s->n_ids;
+	} else {
+		free(s->ids);
+		ids = candidates(&q, &n);
+	}
+
+	m = xmalloc((n ? n : 1) * sizeof(*m));
+	for (i = 0; i < n; i++) {
+		int rank = entry_match(&entries[ids[i]], &q, true);
+
+		if (rank == MATCH_NONE)
+			continue;
+		m[cnt].id = ids[i];
+		m[cnt++].rank = rank;
+		/* keep the matches as candidates for the next query */
+		ids[cnt - 1] = ids[i];
+	}
+
+	free(s->query.text);
+	s->query = q;
+	s->ids = ids;
+	s->n_ids = cnt;
+	s->gen = index_gen;
+
+	sym_arr = match_result(m, cnt, max);
+	free(m);
+
+	return sym_arr;
+}
+
+/*
+ * Ranked search for frontends without search as you type: literal
+ * patterns are ranked as in sym_search_update(), everything else is
+ * passed on to sym_re_search().
+ */
+struct symbol **sym_search_ranked(const char *pattern)
+{
+	struct symbol **sym_arr;
+	struct sym_search *s;
+
+	if (!*pattern || !sym_search_is_literal(pattern))
+		return sym_re_search(pattern);
+
+	s = sym_search_new();
+	sym_arr = sym_search_update(s, pattern, 0);
+	sym_search_free(s);
+
+	return sym_arr;
+}
@@ -819,6 +819,9 @@ struct symbol *sym_lookup(const char *name, int flags)
 	symbol->next = symbol_hash[hash];
 	symbol_hash[hash] = symbol;
 
+	if (new_name && !(flags & SYMBOL_CONST))
+		sym_search_invalidate();
+
 	return symbol;
 }
 
@@ -896,6 +899,9 @@ struct symbol **sym_re_search(const char *pattern)
 	/* Skip if empty */
 	if (strlen(pattern) == 0)
 		return NULL;
+	/* Plain strings can be looked up in the search index */
+	if (sym_search_is_literal(pattern))
+		return sym_search_literal(pattern);
 	if (regcomp(&re, pattern, REG_EXTENDED|REG_ICASE))
 		return NULL;
 
@@ -980,6 +986,8 @@ static void sym_check_print_recursive(struct symbol *last_sym)
 	struct property *prop;
 	struct dep_stack cv_stack;
 
+	parsecache_disable();
+
 	if (sym_is_choice_value(last_sym)) {
 		dep_stack_insert(&cv_stack, last_sym);
 		last_sym = prop_get_symbol(sym_get_choice_prop(last_sym));
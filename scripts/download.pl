@@ -14,6 +14,9 @@ use File::Copy;
 use File::Path;
 use Text::ParseWords;
 use JSON::PP;
+use Fcntl qw(:flock SEEK_SET);
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(time sleep);
 
 @ARGV > 2 or die "Syntax: $0 <target dir> <filename> <hash> <url filename> [<mirror> ...]\n";
 
@@ -28,8 +31,14 @@ my $ok;
 
 my $check_certificate = $ENV{DOWNLOAD_CHECK_CERTIFICATE} eq "y";
 my $custom_tool = $ENV{DOWNLOAD_TOOL_CUSTOM};
+my $mirror_probe = ($ENV{DOWNLOAD_MIRROR_PROBE} // "y") eq "y";
 my $download_tool;
 
+# seconds a mirror gets to answer the probe
+my $probe_timeout = 5;
+# latency in ms recorded for mirrors that fail the probe or the download
+my $probe_penalty = 2 * $probe_timeout * 1000;
+
 $url_filename or $url_filename = $filename;
 
 sub localmirrors {
@@ -122,9 +131,11 @@ sub select_tool {
 sub download_cmd {
 	my $url = shift;
 	my $filename = shift;
+	my $offset = shift;
 
 	if ($download_tool eq "curl") {
 		return (qw(curl -f --connect-timeout 5 --retry 3 --location),
+			$offset ? ('--continue-at', $offset) : (),
 			$check_certificate ? () : '--insecure',
 			shellwords($ENV{CURL_OPTIONS} || ''),
 			$url);
@@ -155,6 +166,183 @@ sub download_cmd {
 	}
 }
 
+sub probe_cmd {
+	my $url = shift;
+
+	if ($download_tool eq "curl") {
+		return (qw(curl -s -f -I --location --output /dev/null),
+			'--max-time', $probe_timeout,
+			$check_certificate ? () : '--insecure',
+			shellwords($ENV{CURL_OPTIONS} || ''),
+			$url);
+	} elsif ($download_tool eq "wget") {
+		return (qw(wget -q --spider --tries=1),
+			"--timeout=$probe_timeout",
+			$check_certificate ? () : '--no-check-certificate',
+			shellwords($ENV{WGET_OPTIONS} || ''),
+			$url);
+	}
+
+	return;
+}
+
+sub mirror_host {
+	my $mirror = shift;
+
+	$mirror =~ m!^(\w+://[^/]+)! or return undef;
+	return lc($1);
+}
+
+sub scores_file {
+	my $dir = $ENV{'TMPDIR'};
+
+	$dir and -d $dir or return undef;
+	return "$dir/.download-mirror-scores";
+}
+
+# Latency of each mirror host in ms, as an exponential moving average of
+# earlier probes. The file is shared by parallel downloads.
+sub scores_load {
+	my %scores;
+	my $file = scores_file() or return %scores;
+
+	open my $fh, "<", $file or return %scores;
+	flock $fh, LOCK_SH;
+	while (<$fh>) {
+		/^(\S+)\s+(\d+(?:\.\d+)?)$/ and $scores{$1} = $2;
+	}
+	close $fh;
+
+	return %scores;
+}
+
+sub scores_update {
+	my $samples = shift;
+	my $file = scores_file() or return;
+	my %scores;
+
+	%$samples or return;
+	open my $fh, "+>>", $file or return;
+	flock $fh, LOCK_EX;
+	seek $fh, 0, SEEK_SET;
+	while (<$fh>) {
+		/^(\S+)\s+(\d+(?:\.\d+)?)$/ and $scores{$1} = $2;
+	}
+
+	foreach my $host (keys %$samples) {
+		my $old = $scores{$host};
+		my $new = $samples->{$host};
+
+		$scores{$host} = defined($old) ? 0.7 * $old + 0.3 * $new : $new;
+	}
+
+	truncate $fh, 0;
+	printf $fh "%s %.1f\n", $_, $scores{$_} foreach sort keys %scores;
+	close $fh;
+}
+
+# Probe all HTTP(S) mirrors concurrently and return the latency in ms of
+# each one that answered; the probes still running are stopped once the
+# others had as long again as the fastest one needed.
+sub probe_mirrors {
+	my %pending;
+	my %latency;
+	my %samples;
+	my $start = time;
+	my $deadline = $start + $probe_timeout;
+
+	foreach my $url (@_) {
+		my $pid = fork();
+		defined $pid or last;
+		if (!$pid) {
+			open STDIN, "<", "/dev/null";
+			open STDOUT, ">", "/dev/null";
+			open STDERR, ">", "/dev/null";
+			exec probe_cmd($url) or POSIX::_exit(1);
+		}
+		$pending{$pid} = $url;
+	}
+
+	while (%pending && time < $deadline) {
+		my $pid = waitpid(-1, WNOHANG);
+
+		if ($pid <= 0) {
+			sleep(0.01);
+			next;
+		}
+
+		my $url = delete $pending{$pid} or next;
+		my $ms = (time - $start) * 1000;
+
+		if ($?) {
+			$samples{mirror_host($url)} = $probe_penalty;
+			next;
+		}
+
+		$latency{$url} = $ms;
+		$samples{mirror_host($url)} = $ms;
+		if (scalar(keys %latency) == 1) {
+			my $grace = $start + 2 * ($ms / 1000) + 0.2;
+			$deadline = $grace if $grace < $deadline;
+		}
+	}
+
+	foreach my $pid (keys %pending) {
+		my $host = mirror_host($pending{$pid});
+
+		kill "TERM", $pid;
+		waitpid($pid, 0);
+		$samples{$host} //= (time - $start) * 1000;
+	}
+
+	scores_update(\%samples);
+	return %latency;
+}
+
+sub mirror_url {
+	my $mirror = shift;
+
+	$mirror =~ s!/$!!;
+	return "$mirror/$url_filename";
+}
+
+# Try the mirrors that answered the probe first, ordered by their latency
+# score, and the ones that did not answer last. Mirrors that cannot be
+# probed keep their relative order in between.
+sub sort_mirrors {
+	my @list = @_;
+	my %probed;
+	my @urls = grep {
+		m!^https?://! && !/a=snapshot/ && !$probed{$_}++
+	} map { mirror_url($_) } @list;
+
+	$mirror_probe && @urls > 1 or return @list;
+	grep { $download_tool eq $_ } qw(curl wget) or return @list;
+
+	my %latency = probe_mirrors(@urls);
+	my %scores = scores_load();
+	my (@fast, @other, @failed);
+
+	foreach my $mirror (@list) {
+		my $url = mirror_url($mirror);
+
+		if (exists $latency{$url}) {
+			push @fast, $mirror;
+		} elsif ($probed{$url}) {
+			push @failed, $mirror;
+		} else {
+			push @other, $mirror;
+		}
+	}
+
+	my %score = map {
+		$_ => $scores{mirror_host($_)} // $latency{mirror_url($_)}
+	} @fast;
+	@fast = sort { $score{$a} <=> $score{$b} } @fast;
+
+	return (@fast, @other, @failed);
+}
+
 my $hash_cmd = hash_cmd();
 $hash_cmd or ($file_hash eq "skip") or die "Cannot find appropriate hash command, ensure the provided hash is either a MD5 or SHA256 checksum.\n";
 
@@ -164,6 +352,7 @@ sub download
 	my $download_filename = shift;
 	my @additional_mirrors = @_;
 	my @cmd;
+	my $offset = 0;
 
 	$mirror =~ s!/$!!;
 
@@ -210,29 +399,55 @@ sub download
 			}
 		};
 	} else {
+		# only curl refuses to resume from servers that ignore the range,
+		# and a partial file of unknown origin is only safe to continue
+		# if the result is verified
+		$offset = $hash_cmd && $download_tool eq "curl" && -s "$target/$filename.dl";
+		$offset or $offset = 0;
+
 		if ($mirror =~ /a=snapshot/) {
-			@cmd = download_cmd("$mirror", $download_filename, @additional_mirrors);
+			@cmd = download_cmd("$mirror", $download_filename, $offset, @additional_mirrors);
 		} else {
-			@cmd = download_cmd("$mirror/$download_filename", $download_filename, @additional_mirrors);
+			@cmd = download_cmd("$mirror/$download_filename", $download_filename, $offset, @additional_mirrors);
 		}
 		print STDERR "+ ".join(" ",@cmd)."\n";
 		open(FETCH_FD, '-|', @cmd) or die "Cannot launch aria2c, curl or wget.\n";
 		$hash_cmd and do {
 			open MD5SUM, "| $hash_cmd > '$target/$filename.hash'" or die "Cannot launch $hash_cmd.\n";
 		};
-		open OUTPUT, "> $target/$filename.dl" or die "Cannot create file $target/$filename.dl: $!\n";
 		my $buffer;
+		if ($offset) {
+			print STDERR "Resuming $filename at $offset bytes.\n";
+			$hash_cmd and do {
+				open PARTIAL, "< $target/$filename.dl" or die "Cannot open file $target/$filename.dl: $!\n";
+				while (read PARTIAL, $buffer, 1048576) {
+					print MD5SUM $buffer;
+				}
+				close PARTIAL;
+			};
+			open OUTPUT, ">> $target/$filename.dl" or die "Cannot open file $target/$filename.dl: $!\n";
+		} else {
+			open OUTPUT, "> $target/$filename.dl" or die "Cannot create file $target/$filename.dl: $!\n";
+		}
 		while (read FETCH_FD, $buffer, 1048576) {
 			$hash_cmd and print MD5SUM $buffer;
 			print OUTPUT $buffer;
 		}
 		$hash_cmd and close MD5SUM;
 		close FETCH_FD;
+		my $status = $? >> 8;
 		close OUTPUT;
 
-		if ($? >> 8) {
+		if ($status) {
 			print STDERR "Download failed.\n";
-			cleanup();
+			unlink "$target/$filename.hash";
+			# keep the partial file for the next mirror unless the
+			# server cannot continue it
+			if ($offset && $status == 33) {
+				cleanup();
+				return download($mirror, $download_filename, @additional_mirrors);
+			}
+			$hash_cmd && $download_tool eq "curl" or cleanup();
 			return;
 		}
 	}
@@ -245,6 +460,8 @@ sub download
 		if ($sum ne $file_hash) {
 			print STDERR "Hash of the downloaded file does not match (file: $sum, requested: $file_hash) - deleting download.\n";
 			cleanup();
+			# the partial file may have been stale, start over
+			$offset and return download($mirror, $download_filename, @additional_mirrors);
 			return;
 		}
 	};
@@ -261,6 +478,7 @@ sub cleanup
 }
 
 @mirrors = localmirrors();
+my $local_mirrors = @mirrors;
 
 foreach my $mirror (@ARGV) {
 	if ($mirror =~ /^\@SF\/(.+)$/) {
@@ -322,23 +540,38 @@ if (-f "$target/$filename") {
 
 $download_tool = select_tool();
 
-my $mirror = shift @mirrors;
+# local mirrors are always tried first, in the configured order
+my @upstream_mirrors = splice(@mirrors, $local_mirrors);
+
+# The upstream mirrors are only probed and sorted once all local mirrors
+# have failed, so that a download from a local mirror never waits for the
+# probes.
+sub next_mirror {
+	if (!@mirrors && @upstream_mirrors) {
+		@mirrors = sort_mirrors(@upstream_mirrors);
+		@upstream_mirrors = ();
+
+		# Try snapshot original source last
+		push @mirrors, shift @mirrors if $mirrors[0] =~ /snapshot/;
+	}
 
-# Try snapshot original source last
-if ($mirror =~ /snapshot/) {
-	push @mirrors, $mirror;
-	$mirror = shift @mirrors;
+	return shift @mirrors;
 }
 
 while (!-f "$target/$filename") {
-	$mirror or die "No more mirrors to try - giving up.\n";
+	my $mirror = next_mirror() or do {
+		cleanup();
+		die "No more mirrors to try - giving up.\n";
+	};
 
-	download($mirror, $url_filename, @mirrors);
+	download($mirror, $url_filename, @mirrors, @upstream_mirrors);
 	if (!-f "$target/$filename" && $url_filename ne $filename) {
-		download($mirror, $filename, @mirrors);
+		download($mirror, $filename, @mirrors, @upstream_mirrors);
+	}
+	if (!-f "$target/$filename" && $mirror_probe) {
+		my $host = mirror_host($mirror);
+		$host and scores_update({ $host => $probe_penalty });
 	}
-
-	$mirror = shift @mirrors;
 }
 
 $SIG{INT} = \&cleanup;
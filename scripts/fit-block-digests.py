@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""
+Write the SHA256 digest of every block of a file, as used by the
+'block-hash' node of uImage.FIT filesystem sub-images. The file size must
+be a multiple of the block size.
+
+The table is stored inside the FIT structure, which fitblk only reads up
+to FIT_MAX_PAGES (1024) pages. Fail instead of producing an image that
+cannot be mapped if the table would not fit.
+"""
+
+import hashlib
+import os
+import sys
+from argparse import ArgumentParser
+
+# FIT_MAX_PAGES * PAGE_SIZE in the fitblk driver, minus room for the rest
+# of the FIT structure
+FIT_MAX_SIZE = 1024 * 4096
+FIT_RESERVED = 64 * 1024
+DIGEST_SIZE = 32
+
+
+def main():
+    parser = ArgumentParser()
+    parser.add_argument("-b", "--block-size", type=int, default=4096)
+    parser.add_argument("-m", "--max-size", type=int,
+                        default=FIT_MAX_SIZE - FIT_RESERVED,
+                        help="maximum size of the digest table in bytes")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    bs = args.block_size
+    if bs < 512 or bs & (bs - 1):
+        print(f"Invalid block size {bs}", file=sys.stderr)
+        return 1
+
+    size = os.path.getsize(args.input)
+    if size // bs * DIGEST_SIZE > args.max_size:
+        print(f"{args.input}: block digests would take {size // bs * DIGEST_SIZE} "
+              f"bytes, the FIT structure allows {args.max_size} "
+              f"(rootfs at most {args.max_size // DIGEST_SIZE * bs} bytes)",
+              file=sys.stderr)
+        return 1
+
+    with open(args.input, "rb") as f, open(args.output, "wb") as out:
+        while True:
+            block = f.read(bs)
+            if not block:
+                break
+            if len(block) != bs:
+                print(f"{args.input}: size not a multiple of {bs}", file=sys.stderr)
+                return 1
+            out.write(hashlib.sha256(block).digest())
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,130 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Content-addressed cache for Build/* image steps.
+#
+# Usage:
+#   image-step-cache.sh run <cache dir> <stats file> <run id> <name> <output> <step file>
+#   image-step-cache.sh stats <stats file>
+#   image-step-cache.sh prune <cache dir> <max size in MiB>
+#
+# The step file holds the expanded recipe of a single Build/* command.
+# Its key is the hash of the command name, the recipe text (with the
+# output path replaced by a placeholder), the environment variables named
+# in IMAGE_STEP_CACHE_ENV, the current contents of the output file and
+# the contents of every other existing file referenced by the recipe. On
+# a hit the cached result is copied to the output, otherwise the recipe
+# is run line by line like make would and the result is stored.
+#
+# Hits refresh the modification time of an entry, prune removes the
+# least recently used entries until the cache fits the size limit.
+#
+# Recipes using shell command substitution may read files that cannot be
+# seen here, so their results are only reused within the same run.
+
+MKHASH="${MKHASH:-mkhash}"
+
+step_key() {
+	local run="$1" name="$2" output="$3" step="$4"
+	local text word
+
+	text="$(cat "$step")"
+	{
+		case "$text" in
+		*'$('*|*'`'*) echo "$run" ;;
+		esac
+		echo "$name"
+		for var in $IMAGE_STEP_CACHE_ENV; do
+			echo "$var=${!var}"
+		done
+		echo "${text//"$output"/@OUT@}"
+		[ -f "$output" ] && "$MKHASH" sha256 "$output"
+		tr -s '\t =;|<>()"'"'"'' '\n' < "$step" | sort -u | \
+		while IFS= read -r word; do
+			case "$word" in
+			"$output"|"$output".*) continue ;;
+			/*) [ -f "$word" ] || continue ;;
+			*) continue ;;
+			esac
+			"$MKHASH" -n sha256 "$word"
+		done
+	} | "$MKHASH" sha256
+}
+
+run_step() {
+	local step="$1"
+	local line="" cmd ignore
+
+	while IFS= read -r cur || [ -n "$cur" ]; do
+		line="$line$cur"
+		case "$cur" in
+		*\\) line="$line"$'\n'; continue ;;
+		esac
+
+		cmd="${line#"${line%%[![:space:]]*}"}"
+		line=""
+		ignore=
+		while :; do
+			case "$cmd" in
+			@*|+*) cmd="${cmd:1}" ;;
+			-*) ignore=1; cmd="${cmd:1}" ;;
+			*) break ;;
+			esac
+		done
+		[ -n "$cmd" ] || continue
+
+		${SHELL:-/bin/sh} -c "$cmd" || [ -n "$ignore" ] || return 1
+	done < "$step"
+}
+
+case "$1" in
+run)
+	cachedir="$2"; stats="$3"; run="$4"; name="$5"; output="$6"; step="$7"
+
+	mkdir -p "$cachedir"
+	key="$(step_key "$run" "$name" "$output" "$step")"
+	entry="$cachedir/${key:0:2}/$key"
+
+	# the entry may be pruned by a concurrent build, run the step then
+	if [ -n "$key" ] && cp "$entry" "$output.cache" 2>/dev/null; then
+		mv "$output.cache" "$output" || exit 1
+		touch -c "$entry"
+		echo "hit $name" >> "$stats"
+	else
+		rm -f "$output.cache"
+		run_step "$step" || exit 1
+		if [ -n "$key" ] && [ -f "$output" ]; then
+			mkdir -p "${entry%/*}"
+			cp "$output" "$entry.$$" && mv "$entry.$$" "$entry"
+		fi
+		echo "miss $name" >> "$stats"
+	fi
+	rm -f "$step"
+	;;
+stats)
+	[ -s "$2" ] || exit 0
+	awk '
+		{ total[$2]++; if ($1 == "hit") hit[$2]++; all++; hits += ($1 == "hit") }
+		END {
+			printf "Image step cache: %d/%d hits\n", hits, all
+			for (n in total)
+				printf "  %-24s %5d hits %5d misses\n", n, hit[n], total[n] - hit[n]
+		}' "$2"
+	;;
+prune)
+	cachedir="$2"; max=$((${3:-0} * 1024 * 1024))
+
+	[ -d "$cachedir" ] && [ "$max" -gt 0 ] || exit 0
+	find "$cachedir" -type f -printf '%T@ %s %p\n' | sort -rn | \
+		awk -v max="$max" '
+			{ total += $2 }
+			total > max { sub(/^[^ ]+ [^ ]+ /, ""); print }' | \
+		xargs -r -d '\n' rm -f --
+	;;
+*)
+	echo "Usage: $0 run <cache dir> <stats file> <run id> <name> <output> <step file>" >&2
+	echo "       $0 stats <stats file>" >&2
+	echo "       $0 prune <cache dir> <max size in MiB>" >&2
+	exit 1
+	;;
+esac
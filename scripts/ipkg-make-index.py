@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+Generate an opkg Packages index for all .ipk files below a directory.
+
+Produces the same output as the historic shell loop in ipkg-make-index.sh,
+but reads every package only once: the SHA256 sum is computed on the raw
+bytes while the outer tar.gz is streamed to find ./control.tar.gz.
+Packages are processed in parallel.
+
+With --cache, the size, mtime, hash and index entry of every package are
+stored in a cache file, and entries of unchanged packages are reused on the
+next run without reading the package again.
+"""
+
+import hashlib
+import io
+import json
+import os
+import sys
+import tarfile
+from concurrent.futures import ProcessPoolExecutor
+
+SKIP_PACKAGES = ("kernel", "libc")
+
+
+class HashingReader(io.RawIOBase):
+    def __init__(self, f):
+        self.f = f
+        self.hash = hashlib.sha256()
+
+    def readable(self):
+        return True
+
+    def readinto(self, buf):
+        data = self.f.read(len(buf))
+        self.hash.update(data)
+        buf[: len(data)] = data
+        return len(data)
+
+    def drain(self):
+        while True:
+            data = self.f.read(1 << 16)
+            if not data:
+                break
+            self.hash.update(data)
+        return self.hash.hexdigest()
+
+
+def extract_member(tar, names):
+    for member in tar:
+        if member.name in names and member.isfile():
+            return tar.extractfile(member).read()
+    return None
+
+
+def read_control(path):
+    with open(path, "rb") as f:
+        reader = HashingReader(f)
+        control = None
+        try:
+            stream = io.BufferedReader(reader, 1 << 16)
+            with tarfile.open(fileobj=stream, mode="r|gz") as outer:
+                control_tar = extract_member(
+                    outer, ("./control.tar.gz", "control.tar.gz")
+                )
+            if control_tar is not None:
+                with tarfile.open(fileobj=io.BytesIO(control_tar), mode="r:gz") as inner:
+                    control = extract_member(inner, ("./control", "control"))
+        except (tarfile.TarError, OSError, EOFError) as e:
+            print(f"Failed to read control data from {path}: {e}", file=sys.stderr)
+
+        return reader.drain(), control
+
+
+def index_entry(pkg, size, sha256sum, control):
+    if control is None:
+        return b"\n"
+
+    filename = pkg[2:] if pkg.startswith("./") else pkg
+    header = (
+        f"Filename: {filename}\nSize: {size}\nSHA256sum: {sha256sum}\n"
+    ).encode()
+
+    lines = control.splitlines(keepends=True)
+    out = b"".join(
+        header + line if line.startswith(b"Description:") else line
+        for line in lines
+    )
+    return out + b"\n"
+
+
+def process(job):
+    pkg, size, mtime = job
+    print(f"Generating index for package {pkg}", file=sys.stderr)
+    sha256sum, control = read_control(pkg)
+    entry = index_entry(pkg, size, sha256sum, control)
+    return pkg, {
+        "size": size,
+        "mtime": mtime,
+        "sha256": sha256sum,
+        "entry": entry.decode("utf-8", "surrogateescape"),
+    }
+
+
+def find_packages(pkg_dir):
+    pkgs = []
+    for root, dirs, files in os.walk(pkg_dir):
+        for name in files:
+            if name.endswith(".ipk"):
+                pkgs.append(os.path.join(root, name))
+
+    # match `find | sort` with LC_ALL=C
+    return sorted(pkgs, key=lambda p: p.encode("utf-8", "surrogateescape"))
+
+
+def load_cache(path):
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return {}
+
+
+def parse_args():
+    from argparse import ArgumentParser
+
+    parser = ArgumentParser()
+    # fmt: off
+    parser.add_argument("-c", "--cache",
+                        help="Reuse entries of unchanged packages from this cache file")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(),
+                        help="Number of packages to process in parallel")
+    parser.add_argument(dest="pkg_dir",
+                        help="Directory to search for .ipk files")
+    # fmt: on
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    if not os.path.isdir(args.pkg_dir):
+        print("Usage: ipkg-make-index <package_directory>", file=sys.stderr)
+        return 1
+
+    pkgs = find_packages(args.pkg_dir)
+    cache = load_cache(args.cache) if args.cache else {}
+    entries = {}
+    jobs = []
+
+    for pkg in pkgs:
+        name = os.path.basename(pkg).split("_", 1)[0]
+        if name in SKIP_PACKAGES:
+            continue
+
+        st = os.stat(pkg)
+        cached = cache.get(pkg)
+        if (
+            cached
+            and cached.get("size") == st.st_size
+            and cached.get("mtime") == st.st_mtime_ns
+        ):
+            entries[pkg] = cached
+        else:
+            jobs.append((pkg, st.st_size, st.st_mtime_ns))
+
+    if len(jobs) > 1 and args.jobs > 1:
+        with ProcessPoolExecutor(max_workers=args.jobs) as executor:
+            entries.update(executor.map(process, jobs, chunksize=8))
+    else:
+        entries.update(map(process, jobs))
+
+    out = sys.stdout.buffer
+    for pkg in pkgs:
+        if pkg in entries:
+            out.write(entries[pkg]["entry"].encode("utf-8", "surrogateescape"))
+    if not pkgs:
+        out.write(b"\n")
+    out.flush()
+
+    if args.cache:
+        tmp = f"{args.cache}.tmp"
+        with open(tmp, "w") as f:
+            json.dump(entries, f)
+        os.replace(tmp, args.cache)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,6 +8,13 @@ if [ -z $pkg_dir ] || [ ! -d $pkg_dir ]; then
 	exit 1
 fi
 
+# Use the parallel indexer if possible, IPKG_INDEX_CACHE names an optional
+# cache file to reuse the entries of unchanged packages
+if command -v python3 >/dev/null 2>&1; then
+	exec python3 "$(dirname "$0")/ipkg-make-index.py" \
+		${IPKG_INDEX_CACHE:+--cache "$IPKG_INDEX_CACHE"} "$pkg_dir"
+fi
+
 empty=1
 
 for pkg in `find $pkg_dir -name '*.ipk' | sort`; do
@@ -31,6 +31,7 @@ usage() {
 	printf "\n\t-n ==> fdt unit-address 'address'"
 	printf "\n\t-d ==> include Device Tree Blob 'dtb'"
 	printf "\n\t-r ==> include RootFS blob 'rootfs'"
+	printf "\n\t-b ==> include RootFS block digests for on-read verification"
 	printf "\n\t-H ==> specify hash algo instead of SHA1"
 	printf "\n\t-l ==> legacy mode character (@ etc otherwise -)"
 	printf "\n\t-o ==> create output file 'its_file'"
@@ -49,11 +50,12 @@ LOADABLES=
 DTOVERLAY=
 DTADDR=
 
-while getopts ":A:a:c:C:D:d:e:f:i:k:l:n:o:O:v:r:s:H:" OPTION
+while getopts ":A:a:bc:C:D:d:e:f:i:k:l:n:o:O:v:r:s:H:" OPTION
 do
 	case $OPTION in
 		A ) ARCH=$OPTARG;;
 		a ) LOAD_ADDR=$OPTARG;;
+		b ) BLOCK_HASH=1;;
 		c ) CONFIG=$OPTARG;;
 		C ) COMPRESS=$OPTARG;;
 		D ) DEVICE=$OPTARG;;
@@ -87,6 +89,11 @@ if [ -n "${ROOTFS}" ] && [ ! -f "${ROOTFS}".pagesync ]; then
 	exit 1
 fi
 
+if [ -n "${BLOCK_HASH}" ] && [ ! -f "${ROOTFS}".pagesync.digests ]; then
+	echo "Missing .pagesync.digests blob for RootFS blob '${ROOTFS}'"
+	exit 1
+fi
+
 ARCH_UPPER=$(echo "$ARCH" | tr '[:lower:]' '[:upper:]')
 
 if [ -n "${COMPATIBLE}" ]; then
@@ -141,6 +148,12 @@ fi
 
 
 if [ -n "${ROOTFS}" ]; then
+	[ -n "${BLOCK_HASH}" ] && BLOCK_HASH_NODE="
+			block-hash {
+				algo = \"sha256\";
+				block-size = <4096>;
+				value = /incbin/(\"${ROOTFS}.pagesync.digests\");
+			};"
 	ROOTFS_NODE="
 		rootfs${REFERENCE_CHAR}$ROOTFSNUM {
 			description = \"${ARCH_UPPER} OpenWrt ${DEVICE} rootfs\";
@@ -154,7 +167,7 @@ if [ -n "${ROOTFS}" ]; then
 			};
 			hash${REFERENCE_CHAR}2 {
 				algo = \"${HASH}\";
-			};
+			};${BLOCK_HASH_NODE}
 		};
 "
 	LOADABLES="${LOADABLES:+$LOADABLES, }\"rootfs${REFERENCE_CHAR}${ROOTFSNUM}\""
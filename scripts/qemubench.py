@@ -0,0 +1,337 @@
+#!/usr/bin/env python3
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Benchmark driver for scripts/qemustart --bench. Runs the given qemu
+# command line headless and measures:
+#
+# - boot time until procd reports "init complete"
+# - memory use of the idle system
+# - size of the kernel and rootfs images
+# - NAT forwarding throughput (iperf3) and latency (ping) between two host
+#   network namespaces, one attached to the guest LAN and one to its WAN
+#
+# The guest network is isolated from the host: both NICs are tap devices
+# moved into private namespaces. Results are written as JSON and can be
+# compared against a baseline from an earlier run.
+
+import argparse
+import json
+import os
+import re
+import select
+import shutil
+import signal
+import subprocess
+import sys
+import time
+
+LAN_HOST = "192.168.1.2"
+LAN_GUEST = "192.168.1.1"
+WAN_HOST = "192.168.7.1"
+WAN_GUEST = "192.168.7.2"
+
+# markers around command output, quoted on the command line so that the
+# echoed input does not match
+BEGIN = "__QB_BEGIN__"
+END = "__QB_END__"
+
+# metric -> True if a higher value is better
+METRICS = {
+    "boot_time_s": False,
+    "mem_free_kb": True,
+    "mem_available_kb": True,
+    "rss_kb": False,
+    "kernel_size": False,
+    "rootfs_size": False,
+    "throughput_mbps": True,
+    "latency_avg_ms": False,
+}
+
+
+def log(msg):
+    print("qemubench: %s" % msg, file=sys.stderr)
+
+
+def sudo(*cmd, check=True, **kwargs):
+    if os.geteuid():
+        cmd = ("sudo",) + cmd
+    return subprocess.run(cmd, check=check, **kwargs)
+
+
+def netns(ns, *cmd, **kwargs):
+    return sudo("ip", "netns", "exec", ns, *cmd, **kwargs)
+
+
+class Console:
+    def __init__(self, proc):
+        self.proc = proc
+        self.buf = ""
+
+    def expect(self, pattern, timeout):
+        regex = re.compile(pattern)
+        end = time.monotonic() + timeout
+        while True:
+            m = regex.search(self.buf)
+            if m:
+                out = self.buf[:m.start()]
+                self.buf = self.buf[m.end():]
+                return m, out
+
+            left = end - time.monotonic()
+            if left <= 0:
+                raise TimeoutError("timeout waiting for %r" % pattern)
+
+            ready, _, _ = select.select([self.proc.stdout], [], [], left)
+            if not ready:
+                continue
+
+            data = os.read(self.proc.stdout.fileno(), 65536)
+            if not data:
+                raise EOFError("qemu exited")
+            self.buf += data.decode(errors="replace").replace("\r", "")
+
+    def send(self, line):
+        self.proc.stdin.write((line + "\n").encode())
+        self.proc.stdin.flush()
+
+    def run(self, cmd, timeout=60):
+        self.send("echo %s; %s; echo %s$?" % (BEGIN.replace("_B", '_""B'),
+                                              cmd, END.replace("_E", '_""E')))
+        self.expect(BEGIN + "\n", timeout)
+        m, out = self.expect(END + r"(\d+)\n", timeout)
+        if m.group(1) != "0":
+            raise RuntimeError("'%s' failed: %s" % (cmd, out.strip()))
+        return out
+
+
+class Network:
+    def __init__(self, prefix):
+        self.lan = prefix + "l"
+        self.wan = prefix + "w"
+        self.created = []
+
+    def setup(self):
+        user = str(os.getuid())
+        for name in (self.lan, self.wan):
+            sudo("ip", "netns", "add", name)
+            self.created.append(name)
+            sudo("ip", "tuntap", "add", "dev", name, "mode", "tap",
+                 "user", user)
+            sudo("ip", "link", "set", name, "up")
+
+    def attach(self, timeout=30):
+        # the taps can only be moved once qemu opened them
+        end = time.monotonic() + timeout
+        for name in (self.lan, self.wan):
+            path = "/sys/class/net/%s/carrier" % name
+            while True:
+                try:
+                    with open(path) as f:
+                        if f.read().strip() == "1":
+                            break
+                except OSError:
+                    pass
+                if time.monotonic() > end:
+                    raise TimeoutError("qemu did not open %s" % name)
+                time.sleep(0.1)
+            sudo("ip", "link", "set", name, "netns", name)
+
+        for name, addr in ((self.lan, LAN_HOST), (self.wan, WAN_HOST)):
+            netns(name, "ip", "link", "set", "lo", "up")
+            netns(name, "ip", "link", "set", name, "up")
+            netns(name, "ip", "addr", "add", addr + "/24", "dev", name)
+        netns(self.lan, "ip", "route", "add", "default", "via", LAN_GUEST)
+
+    def cleanup(self):
+        for name in self.created:
+            sudo("ip", "netns", "del", name, check=False,
+                 stderr=subprocess.DEVNULL)
+            sudo("ip", "link", "del", name, check=False,
+                 stderr=subprocess.DEVNULL)
+
+
+def image_sizes(qemu_cmd):
+    res = {}
+    for i, arg in enumerate(qemu_cmd[:-1]):
+        nxt = qemu_cmd[i + 1]
+        if arg == "-kernel":
+            res["kernel_size"] = os.path.getsize(nxt)
+        elif arg == "-drive":
+            m = re.search(r"(?:^|,)file=([^,]+)", nxt)
+            if m:
+                res["rootfs_size"] = os.path.getsize(m.group(1))
+    return res
+
+
+def configure_wan(con):
+    con.run("uci set network.wan.proto=static")
+    con.run("uci set network.wan.ipaddr=%s" % WAN_GUEST)
+    con.run("uci set network.wan.netmask=255.255.255.0")
+    con.run("uci set network.wan.gateway=%s" % WAN_HOST)
+    con.run("uci commit network")
+    con.run("/etc/init.d/network reload")
+
+
+def wait_forwarding(net, timeout):
+    end = time.monotonic() + timeout
+    while time.monotonic() < end:
+        res = netns(net.lan, "ping", "-c", "1", "-W", "1", WAN_HOST,
+                    check=False, stdout=subprocess.DEVNULL)
+        if not res.returncode:
+            return
+        time.sleep(1)
+    raise TimeoutError("no route from LAN to WAN through the guest")
+
+
+def measure_memory(con):
+    res = {}
+    meminfo = con.run("cat /proc/meminfo")
+    for key, name in (("MemFree", "mem_free_kb"),
+                      ("MemAvailable", "mem_available_kb"),
+                      ("MemTotal", "mem_total_kb")):
+        m = re.search(r"^%s:\s+(\d+)" % key, meminfo, re.M)
+        if m:
+            res[name] = int(m.group(1))
+
+    rss = con.run("cat /proc/[0-9]*/status 2>/dev/null | "
+                  "awk '/^VmRSS:/ { s += $2 } END { print s + 0 }'")
+    res["rss_kb"] = int(re.findall(r"\d+", rss)[-1])
+    return res
+
+
+def measure_throughput(net, duration):
+    if not shutil.which("iperf3"):
+        log("iperf3 not found, skipping throughput")
+        return {}
+
+    netns(net.wan, "iperf3", "-s", "-1", "-D")
+    time.sleep(1)
+    res = netns(net.lan, "iperf3", "-c", WAN_HOST, "-t", str(duration), "-J",
+                stdout=subprocess.PIPE)
+    data = json.loads(res.stdout)
+    bps = data["end"]["sum_received"]["bits_per_second"]
+    return {"throughput_mbps": round(bps / 1e6, 2)}
+
+
+def measure_latency(net, count):
+    res = netns(net.lan, "ping", "-q", "-c", str(count), "-i", "0.2",
+                WAN_HOST, stdout=subprocess.PIPE, universal_newlines=True)
+    m = re.search(r"= ([\d.]+)/([\d.]+)/([\d.]+)", res.stdout)
+    if not m:
+        return {}
+    return {
+        "latency_min_ms": float(m.group(1)),
+        "latency_avg_ms": float(m.group(2)),
+        "latency_max_ms": float(m.group(3)),
+    }
+
+
+def compare(result, baseline, tolerance):
+    regressions = 0
+    for name, higher_better in METRICS.items():
+        if name not in result or name not in baseline:
+            continue
+
+        new, old = result[name], baseline[name]
+        change = (new - old) / old * 100 if old else 0.0
+        worse = -change if higher_better else change
+        status = "REGRESSION" if worse > tolerance else "ok"
+        if worse > tolerance:
+            regressions += 1
+        print("%-20s %14s %14s %+8.2f%%  %s" % (name, old, new, change, status))
+
+    return regressions
+
+
+def bench(args, qemu_cmd):
+    result = {"target": args.target}
+    result.update(image_sizes(qemu_cmd))
+
+    net = Network(args.prefix)
+    proc = None
+    try:
+        net.setup()
+        start = time.monotonic()
+        proc = subprocess.Popen(qemu_cmd, stdin=subprocess.PIPE,
+                                stdout=subprocess.PIPE)
+        con = Console(proc)
+        net.attach()
+
+        con.expect(r"procd: - init complete -", args.timeout)
+        result["boot_time_s"] = round(time.monotonic() - start, 3)
+        log("booted in %.1f s" % result["boot_time_s"])
+
+        con.expect(r"Please press Enter to activate this console", 30)
+        con.send("")
+        # keep kernel messages from mixing with command output
+        con.run("echo 1 > /proc/sys/kernel/printk")
+
+        configure_wan(con)
+        wait_forwarding(net, 60)
+
+        time.sleep(args.settle)
+        result.update(measure_memory(con))
+        result.update(measure_throughput(net, args.duration))
+        result.update(measure_latency(net, args.pings))
+
+        con.send("poweroff")
+        proc.wait(timeout=60)
+    finally:
+        if proc and proc.poll() is None:
+            proc.send_signal(signal.SIGTERM)
+            proc.wait()
+        net.cleanup()
+
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        usage="%(prog)s --out FILE [options] -- QEMU-COMMAND...")
+    parser.add_argument("--out", required=True, help="JSON result file")
+    parser.add_argument("--baseline", help="JSON result to compare against")
+    parser.add_argument("--tolerance", type=float, default=5.0,
+                        help="allowed regression in percent (default 5)")
+    parser.add_argument("--target", default="", help="target/subtarget")
+    parser.add_argument("--prefix", default="qb%d" % os.getpid(),
+                        help="name prefix of the tap devices and namespaces")
+    parser.add_argument("--timeout", type=int, default=300,
+                        help="boot timeout in seconds (default 300)")
+    parser.add_argument("--settle", type=int, default=10,
+                        help="idle time before measuring memory (default 10)")
+    parser.add_argument("--duration", type=int, default=10,
+                        help="iperf3 test duration in seconds (default 10)")
+    parser.add_argument("--pings", type=int, default=50,
+                        help="number of pings for latency (default 50)")
+    parser.add_argument("qemu", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    qemu_cmd = args.qemu[1:] if args.qemu[:1] == ["--"] else args.qemu
+    if not qemu_cmd:
+        parser.error("missing qemu command line")
+
+    try:
+        result = bench(args, qemu_cmd)
+    except (TimeoutError, EOFError, RuntimeError,
+            subprocess.CalledProcessError) as e:
+        log("benchmark failed: %s" % e)
+        return 2
+
+    with open(args.out, "w") as f:
+        json.dump(result, f, indent=2, sort_keys=True)
+        f.write("\n")
+    log("results written to %s" % args.out)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if compare(result, baseline, args.tolerance):
+            return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
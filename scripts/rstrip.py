@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2006 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Parallel implementation of rstrip.sh: ELF objects are recognized by their
+# header instead of running file(1) on every file. The files are stripped by
+# RSTRIP_JOBS workers, one unless set, since every package build calls this
+# script and make already runs those builds in parallel. Messages are printed
+# in the same order as the serial version would.
+
+import fnmatch
+import os
+import shlex
+import stat
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+SELF = "rstrip.sh"
+
+ET_REL = 1
+ET_EXEC = 2
+ET_DYN = 3
+
+PT_INTERP = 3
+
+ELF_TYPES = {
+    ET_REL: "relocatable",
+    ET_EXEC: "executable",
+    ET_DYN: "shared object",
+}
+
+RPATH_KEEP = ("/lib/[!/]*", "/usr/lib/[!/]*", "$ORIGIN/*", "$ORIGIN")
+
+
+def walk(path):
+    """Regular files below path, in the order find(1) lists them."""
+    try:
+        st = os.lstat(path)
+    except OSError:
+        return
+
+    if stat.S_ISREG(st.st_mode):
+        yield path
+        return
+
+    if not stat.S_ISDIR(st.st_mode):
+        return
+
+    with os.scandir(path) as it:
+        entries = list(it)
+
+    for entry in entries:
+        child = os.path.join(path, entry.name)
+        if entry.is_dir(follow_symlinks=False):
+            yield from walk(child)
+        elif entry.is_file(follow_symlinks=False):
+            yield child
+
+
+def has_interp(f, hdr, order):
+    # file(1) reports position independent executables as executable
+    if hdr[4] == 1:
+        phoff = int.from_bytes(hdr[28:32], order)
+        phentsize = int.from_bytes(hdr[42:44], order)
+        phnum = int.from_bytes(hdr[44:46], order)
+    else:
+        phoff = int.from_bytes(hdr[32:40], order)
+        phentsize = int.from_bytes(hdr[54:56], order)
+        phnum = int.from_bytes(hdr[56:58], order)
+
+    if phentsize < 4:
+        return False
+
+    f.seek(phoff)
+    phdrs = f.read(phentsize * phnum)
+    return any(int.from_bytes(phdrs[i:i + 4], order) == PT_INTERP
+               for i in range(0, len(phdrs) - 3, phentsize))
+
+
+def elf_type(path):
+    try:
+        with open(path, "rb") as f:
+            hdr = f.read(64)
+            if (len(hdr) < 52 or hdr[:4] != b"\x7fELF" or
+                    hdr[4] not in (1, 2) or hdr[5] not in (1, 2)):
+                return None
+
+            order = "little" if hdr[5] == 1 else "big"
+            e_type = int.from_bytes(hdr[16:18], order)
+            if e_type == ET_DYN and len(hdr) == 64 and \
+                    has_interp(f, hdr, order):
+                e_type = ET_EXEC
+    except OSError:
+        return None
+
+    return ELF_TYPES.get(e_type)
+
+
+def run(cmd, out, err):
+    res = subprocess.run(cmd, shell=isinstance(cmd, str),
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out.append(res.stdout)
+    err.append(res.stderr)
+    return res
+
+
+def split_rpath(rpath):
+    # same field splitting as bash with IFS=":"
+    if not rpath:
+        return []
+    fields = rpath.split(":")
+    if not fields[-1]:
+        fields.pop()
+    return fields
+
+
+def strip_file(path, kind):
+    env = os.environ
+    out = [("%s: %s: %s\n" % (SELF, path, kind)).encode()]
+    err = []
+    size = os.path.getsize(path)
+
+    if kind == "relocatable":
+        if path.rsplit(".", 1)[-1] == "o":
+            return out, err, 0, 0
+        run("%s %s" % (env["STRIP_KMOD"], shlex.quote(path)), out, err)
+        return out, err, size, os.path.getsize(path)
+
+    mode = stat.S_IMODE(os.stat(path).st_mode)
+
+    patchelf = env.get("PATCHELF")
+    if patchelf and env.get("TOPDIR"):
+        res = run([patchelf, "--print-rpath", path], [], err)
+        old_rpath = res.stdout.decode().rstrip("\n")
+        new_rpath = []
+        for p in split_rpath(old_rpath):
+            if any(fnmatch.fnmatchcase(p, pat) for pat in RPATH_KEEP):
+                new_rpath.append(p)
+            else:
+                out.append(("%s: %s: removing rpath %s\n" %
+                            (SELF, path, p)).encode())
+        new_rpath = ":".join(new_rpath)
+        if new_rpath != old_rpath:
+            run([patchelf, "--set-rpath", new_rpath, path], out, err)
+
+    run("%s %s" % (env["STRIP"], shlex.quote(path)), out, err)
+
+    if stat.S_IMODE(os.stat(path).st_mode) != mode:
+        os.chmod(path, mode)
+
+    return out, err, size, os.path.getsize(path)
+
+
+def classify(path):
+    return path, elf_type(path)
+
+
+def main():
+    if not os.environ.get("STRIP"):
+        print("%s: strip command not defined (STRIP variable not set)" % SELF)
+        return 1
+
+    targets = sys.argv[1:]
+    if not targets:
+        print("%s: no directories / files specified" % SELF)
+        print("usage: %s [PATH...]" % SELF)
+        return 1
+
+    jobs = max(int(os.environ.get("RSTRIP_JOBS") or 1), 1)
+    files = [f for t in targets for f in walk(t)
+             if "/lib/firmware/" not in f]
+
+    nfiles = before = after = 0
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        elves = [(p, k) for p, k in pool.map(classify, files) if k]
+        results = pool.map(lambda e: strip_file(*e), elves)
+        for out, err, old_size, new_size in results:
+            sys.stdout.buffer.write(b"".join(out))
+            sys.stdout.buffer.flush()
+            sys.stderr.buffer.write(b"".join(err))
+            sys.stderr.buffer.flush()
+            if old_size:
+                nfiles += 1
+                before += old_size
+                after += new_size
+
+    if nfiles:
+        print("%s: %s: stripped %d files, %d -> %d bytes, saved %d bytes" %
+              (SELF, " ".join(os.path.basename(os.path.normpath(t))
+                              for t in targets),
+               nfiles, before, after, before - after))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
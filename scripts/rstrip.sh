@@ -20,6 +20,10 @@ TARGETS=$*
   exit 1
 }
 
+# identify ELF files by their header, unless python is missing
+command -v python3 >/dev/null && \
+  exec python3 "${0%/*}/rstrip.py" $TARGETS
+
 find $TARGETS -not -path \*/lib/firmware/\* -a -type f -a -exec file {} \; | \
   sed -n -e 's/^\(.*\):.*ELF.*\(executable\|relocatable\|shared object\).*,.*/\1:\2/p' | \
 (
@@ -0,0 +1,95 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Print the content hash used by include/scan.mk to decide whether the
+# metadata of a package or target directory needs to be dumped again.
+#
+# Usage: scan-hash.sh <dir> <context> <file...>
+#
+# The hash covers the given files, the context string (scan options,
+# feed, override) and every makefile included by <dir>/Makefile, followed
+# recursively. If an include cannot be resolved without evaluating the
+# makefiles, all makefiles it could refer to are hashed instead.
+
+dir="$1"; shift
+context="$1"; shift
+top="${TOPDIR:-$PWD}"
+
+# Prints "F <file>" for every makefile in the include closure of
+# <dir>/Makefile, "G <pattern>" for wildcard includes and "U" if an
+# include name depends on other variables. Configuration and build state
+# (.config, tmp/, the kernel and toolchain directories) is not part of it.
+closure() {
+	awk -v dir="$dir" -v top="$top" '
+	function resolve(word) {
+		if (word !~ /^[\/$]/)
+			word = dir "/" word
+		gsub(/\$\(TOPDIR\)/, top, word)
+		gsub(/\$\(INCLUDE_DIR\)/, top "/include", word)
+		gsub(/\$\(SCRIPT_DIR\)/, top "/scripts", word)
+		if (dir ~ /^target\/linux\//)
+			gsub(/\$\(PLATFORM_DIR\)/, dir, word)
+		return word
+	}
+	function add(file) {
+		if (file in seen)
+			return
+		seen[file] = 1
+		queue[n++] = file
+	}
+	BEGIN {
+		add(dir "/Makefile")
+		for (i = 0; i < n; i++) {
+			file = queue[i]
+			if ((getline line < file) < 0)
+				continue
+			print "F " file
+			do {
+				if (!sub(/^[ \t]*-?s?include[ \t]+/, "", line))
+					continue
+				gsub(/\$\(sort \$\(wildcard /, "", line)
+				gsub(/\)\)[ \t]*$/, "", line)
+				nw = split(line, words, /[ \t]+/)
+				for (j = 1; j <= nw; j++) {
+					word = words[j]
+					if (word == "" || word ~ /^#/)
+						break
+					if (word ~ /^\$\((TMP_DIR|TMP_CONFIG|LINUX_DIR|TOOLCHAIN_DIR)\)/ ||
+					    word == "$(TOPDIR)/.config")
+						continue
+					word = resolve(word)
+					if (word ~ /\$/)
+						unresolved = 1
+					else if (word ~ /\*/)
+						print "G " word
+					else
+						add(word)
+				}
+			} while ((getline line < file) > 0)
+			close(file)
+		}
+		if (unresolved)
+			print "U"
+	}'
+}
+
+files() {
+	closure | while read -r type file; do
+		case "$type" in
+		F) echo "$file" ;;
+		G) for f in $file; do [ -f "$f" ] && echo "$f"; done ;;
+		U)
+			for f in "$top"/include/*.mk \
+				 "$top"/target/linux/generic/kernel-* \
+				 "$dir"/*/target.mk "$dir"/*/profiles/*.mk; do
+				[ -f "$f" ] && echo "$f"
+			done
+			;;
+		esac
+	done
+}
+
+{
+	echo "$context"
+	cat "$@" $(files | sort -u) 2>/dev/null
+} | "${MKHASH:-mkhash}" md5
@@ -12,13 +12,26 @@
 ### If no environmental variables are set the script reads the current
 ### .config file. The evaluated env variables are the following:
 ###
-###   TARGET SUBTARGET ARCH PACKAGES BIN_DIR BASE_URL CHECK_INSTALLED
+###   TARGET SUBTARGET ARCH PACKAGES BIN_DIR BASE_URL CHECK_INSTALLED ROOTFS
+###
+### Without network access, a manifest of the installed size, xz compressed
+### size and ELF text/data/bss sizes of every file in the rootfs can be
+### recorded per build and two such manifests compared against each other.
+### ROOTFS defaults to the root directory of the last image build and may
+### also point to a rootfs tarball.
 ###
 ### Usage:
 ###   ./scripts/size_compare.sh
+###   ./scripts/size_compare.sh -r base.json
+###   ./scripts/size_compare.sh -d base.json new.json [-f] [-s field] [-t bytes]
 ###
 ### Options:
 ###   -p --package-size 	Check IPK package size and not installed size
+###   -r --record <file>	Record a footprint manifest of ROOTFS offline
+###   -d --diff <old> <new>	Compare two manifests, sorted by size delta
+###      -f --files		  also list changes per file
+###      -s --sort <field>	  sort by size, compressed, text, data or bss
+###      -t --threshold <n>	  hide changes smaller than n bytes
 ###   -h --help 		This message
 
 eval "$(grep \
@@ -116,6 +129,25 @@ if [ "$1" = "-p" ]; then
     CHECK_INSTALLED=
 fi
 
+case "$1" in
+	-r|--record)
+		[ -n "$2" ] || { help; exit 1; }
+		if [ -z "$ROOTFS" ]; then
+			ROOTFS=$(ls -1d build_dir/target-*/root-"$TARGET" 2>/dev/null | head -n1)
+		fi
+		if [ ! -e "$ROOTFS" ]; then
+			echo "No rootfs found, build an image or set ROOTFS"
+			exit 1
+		fi
+		echo "Recording footprint of $ROOTFS to $2"
+		exec python3 "${0%/*}/size_manifest.py" record "$ROOTFS" "$2"
+		;;
+	-d|--diff)
+		shift
+		exec python3 "${0%/*}/size_manifest.py" diff "$@"
+		;;
+esac
+
 echo "Compare packages of $TARGET/$SUBTARGET/$ARCH":
 echo "$PACKAGES"
 echo
@@ -0,0 +1,289 @@
+#!/usr/bin/env python3
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Record and compare the footprint of a root filesystem, offline.
+#
+# "record" walks a rootfs (build directory or rootfs tarball) and writes a
+# JSON manifest with the size of every file, an xz compressed size as an
+# estimate of its cost on squashfs, and for ELF objects the text, data and
+# bss section sizes as reported by size(1). Files are assigned to packages
+# using the opkg or apk database found in the rootfs.
+#
+# "diff" compares two manifests per package (and optionally per file) and
+# lists the changes sorted by size delta, largest growth first.
+
+import argparse
+import json
+import lzma
+import os
+import stat
+import sys
+import tarfile
+
+UNOWNED = "(unowned)"
+
+SHT_NOBITS = 8
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+
+FIELDS = ("size", "compressed", "text", "data", "bss")
+
+
+def elf_sections(data):
+    """Berkeley style text/data/bss sizes of an ELF image, or None."""
+    if len(data) < 52 or data[:4] != b"\x7fELF" or \
+            data[4] not in (1, 2) or data[5] not in (1, 2):
+        return None
+
+    order = "little" if data[5] == 1 else "big"
+
+    def u(off, size):
+        return int.from_bytes(data[off:off + size], order)
+
+    if data[4] == 1:
+        shoff, shentsize, shnum = u(32, 4), u(46, 2), u(48, 2)
+        flags_off, flags_len, size_off, size_len = 8, 4, 20, 4
+    else:
+        shoff, shentsize, shnum = u(40, 8), u(58, 2), u(60, 2)
+        flags_off, flags_len, size_off, size_len = 8, 8, 32, 8
+
+    if not shoff or shoff + shentsize * shnum > len(data):
+        return None
+
+    text = dat = bss = 0
+    for i in range(shnum):
+        sh = shoff + i * shentsize
+        sh_type = u(sh + 4, 4)
+        sh_flags = u(sh + flags_off, flags_len)
+        sh_size = u(sh + size_off, size_len)
+
+        if not sh_flags & SHF_ALLOC:
+            continue
+        if sh_type == SHT_NOBITS:
+            bss += sh_size
+        elif sh_flags & SHF_WRITE:
+            dat += sh_size
+        else:
+            text += sh_size
+
+    return {"text": text, "data": dat, "bss": bss}
+
+
+def file_entry(data):
+    entry = {
+        "size": len(data),
+        "compressed": len(lzma.compress(data, preset=6)) if data else 0,
+    }
+    entry.update(elf_sections(data) or {})
+    return entry
+
+
+class DirRootfs:
+    def __init__(self, path):
+        self.path = path
+
+    def read(self, name):
+        try:
+            with open(os.path.join(self.path, name), "rb") as f:
+                return f.read()
+        except OSError:
+            return None
+
+    def listdir(self, name):
+        try:
+            return os.listdir(os.path.join(self.path, name))
+        except OSError:
+            return []
+
+    def files(self):
+        for top, dirs, files in os.walk(self.path):
+            dirs.sort()
+            for name in sorted(files):
+                path = os.path.join(top, name)
+                st = os.lstat(path)
+                if not stat.S_ISREG(st.st_mode):
+                    continue
+                rel = "/" + os.path.relpath(path, self.path)
+                with open(path, "rb") as f:
+                    yield rel, f.read()
+
+
+class TarRootfs:
+    def __init__(self, path):
+        self.tar = tarfile.open(path)
+        self.members = {}
+        for m in self.tar.getmembers():
+            name = os.path.normpath(m.name)
+            if name != ".":
+                self.members["/" + name.lstrip("/")] = m
+
+    def read(self, name):
+        m = self.members.get("/" + name)
+        if not m or not m.isfile():
+            return None
+        return self.tar.extractfile(m).read()
+
+    def listdir(self, name):
+        prefix = "/" + name.rstrip("/") + "/"
+        return [n[len(prefix):] for n in self.members
+                if n.startswith(prefix) and "/" not in n[len(prefix):]]
+
+    def files(self):
+        for name in sorted(self.members):
+            m = self.members[name]
+            if m.isfile():
+                yield name, self.tar.extractfile(m).read()
+
+
+def owners(rootfs):
+    """Map of file path to package name from the package database."""
+    res = {}
+
+    data = rootfs.read("lib/apk/db/installed")
+    if data:
+        pkg = cwd = None
+        for line in data.decode(errors="replace").splitlines():
+            if line.startswith("P:"):
+                pkg = line[2:]
+            elif line.startswith("F:"):
+                cwd = line[2:]
+            elif line.startswith("R:") and pkg:
+                res["/%s/%s" % (cwd, line[2:]) if cwd else "/" + line[2:]] = pkg
+            elif not line:
+                pkg = cwd = None
+        return res
+
+    info = "usr/lib/opkg/info"
+    for name in rootfs.listdir(info):
+        if not name.endswith(".list"):
+            continue
+        data = rootfs.read("%s/%s" % (info, name)) or b""
+        for line in data.decode(errors="replace").splitlines():
+            path = line.split("\t")[0]
+            if path:
+                res[path] = name[:-5]
+
+    return res
+
+
+def record(args):
+    if os.path.isdir(args.rootfs):
+        rootfs = DirRootfs(args.rootfs)
+    else:
+        rootfs = TarRootfs(args.rootfs)
+
+    owner = owners(rootfs)
+    if not owner:
+        print("size_manifest: no package database in %s, files will not "
+              "be assigned to packages" % args.rootfs, file=sys.stderr)
+
+    packages = {}
+    for path, data in rootfs.files():
+        pkg = packages.setdefault(owner.get(path, UNOWNED), {})
+        pkg[path] = file_entry(data)
+
+    manifest = {"rootfs": args.rootfs, "packages": packages}
+    with open(args.output, "w") as f:
+        json.dump(manifest, f, indent=1, sort_keys=True)
+        f.write("\n")
+
+    return 0
+
+
+def total(files):
+    res = dict.fromkeys(FIELDS, 0)
+    for entry in files.values():
+        for field in FIELDS:
+            res[field] += entry.get(field, 0)
+    return res
+
+
+def delta_rows(old, new):
+    rows = []
+    for name in set(old) | set(new):
+        a = old.get(name, {})
+        b = new.get(name, {})
+        d = {f: b.get(f, 0) - a.get(f, 0) for f in FIELDS}
+        if name not in old:
+            state = "new"
+        elif name not in new:
+            state = "removed"
+        elif any(d.values()):
+            state = ""
+        else:
+            continue
+        rows.append((name, state, d))
+    return rows
+
+
+def print_rows(rows, key, threshold):
+    for name, state, d in sorted(rows, key=lambda r: (-r[2][key], r[0])):
+        if abs(d[key]) < threshold:
+            continue
+        print("%+10d %+10d %+9d %+8d %+8d  %s%s" % (
+            d["size"], d["compressed"], d["text"], d["data"], d["bss"],
+            name, " (%s)" % state if state else ""))
+
+
+def diff(args):
+    with open(args.old) as f:
+        old = json.load(f)["packages"]
+    with open(args.new) as f:
+        new = json.load(f)["packages"]
+
+    header = "%10s %10s %9s %8s %8s  %s" % (
+        "size", "xz", "text", "data", "bss", "%s")
+
+    print(header % "package")
+    pkg_rows = delta_rows({k: total(v) for k, v in old.items()},
+                          {k: total(v) for k, v in new.items()})
+    print_rows(pkg_rows, args.sort, args.threshold)
+
+    if args.files:
+        old_files = {p: e for files in old.values() for p, e in files.items()}
+        new_files = {p: e for files in new.values() for p, e in files.items()}
+        print()
+        print(header % "file")
+        print_rows(delta_rows(old_files, new_files), args.sort, args.threshold)
+
+    a = total({n: total(v) for n, v in old.items()})
+    b = total({n: total(v) for n, v in new.items()})
+    print("~~~~~~~")
+    print("%+10d %+10d %+9d %+8d %+8d  total change" % tuple(
+        b[f] - a[f] for f in FIELDS))
+    print("%10d %10d %9d %8d %8d  total" % tuple(b[f] for f in FIELDS))
+    print("RAM (data + bss) change: %+d bytes" %
+          (b["data"] + b["bss"] - a["data"] - a["bss"]))
+
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Record and compare rootfs footprint manifests")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("record", help="write a manifest of a rootfs")
+    p.add_argument("rootfs", help="rootfs directory or tarball")
+    p.add_argument("output", help="manifest file to write")
+    p.set_defaults(func=record)
+
+    p = sub.add_parser("diff", help="compare two manifests")
+    p.add_argument("old", help="baseline manifest")
+    p.add_argument("new", help="manifest to compare")
+    p.add_argument("-f", "--files", action="store_true",
+                   help="also list changes per file")
+    p.add_argument("-s", "--sort", choices=FIELDS, default="size",
+                   help="column to sort by (default size)")
+    p.add_argument("-t", "--threshold", type=int, default=1,
+                   help="hide changes smaller than this many bytes")
+    p.set_defaults(func=diff)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -279,6 +279,7 @@ static const struct nla_policy switch_policy[SWITCH_ATTR_MAX+1] = {
 	[SWITCH_ATTR_OP_VALUE_STR] = { .type = NLA_NUL_STRING },
 	[SWITCH_ATTR_OP_VALUE_PORTS] = { .type = NLA_NESTED },
 	[SWITCH_ATTR_TYPE] = { .type = NLA_U32 },
+	[SWITCH_ATTR_OP_BATCH] = { .type = NLA_NESTED },
 };
 
 static const struct nla_policy port_policy[SWITCH_PORT_ATTR_MAX+1] = {
@@ -493,10 +494,9 @@ out:
 }
 
 static const struct switch_attr *
-swconfig_lookup_attr(struct switch_dev *dev, struct genl_info *info,
+swconfig_lookup_attr(struct switch_dev *dev, int cmd, struct nlattr **attrs,
 		struct switch_val *val)
 {
-	struct genlmsghdr *hdr = nlmsg_data(info->nlhdr);
 	const struct switch_attrlist *alist;
 	const struct switch_attr *attr = NULL;
 	unsigned int attr_id;
@@ -506,10 +506,10 @@ swconfig_lookup_attr(struct switch_dev *dev, struct genl_info *info,
 	unsigned long *def_active;
 	int n_def;
 
-	if (!info->attrs[SWITCH_ATTR_OP_ID])
+	if (!attrs[SWITCH_ATTR_OP_ID])
 		goto done;
 
-	switch (hdr->cmd) {
+	switch (cmd) {
 	case SWITCH_CMD_SET_GLOBAL:
 	case SWITCH_CMD_GET_GLOBAL:
 		alist = &dev->ops->attr_global;
@@ -523,9 +523,9 @@ swconfig_lookup_attr(struct switch_dev *dev, struct genl_info *info,
 		def_list = default_vlan;
 		def_active = &dev->def_vlan;
 		n_def = ARRAY_SIZE(default_vlan);
-		if (!info->attrs[SWITCH_ATTR_OP_VLAN])
+		if (!attrs[SWITCH_ATTR_OP_VLAN])
 			goto done;
-		val->port_vlan = nla_get_u32(info->attrs[SWITCH_ATTR_OP_VLAN]);
+		val->port_vlan = nla_get_u32(attrs[SWITCH_ATTR_OP_VLAN]);
 		if (val->port_vlan >= dev->vlans)
 			goto done;
 		break;
@@ -535,9 +535,9 @@ swconfig_lookup_attr(struct switch_dev *dev, struct genl_info *info,
 		def_list = default_port;
 		def_active = &dev->def_port;
 		n_def = ARRAY_SIZE(default_port);
-		if (!info->attrs[SWITCH_ATTR_OP_PORT])
+		if (!attrs[SWITCH_ATTR_OP_PORT])
 			goto done;
-		val->port_vlan = nla_get_u32(info->attrs[SWITCH_ATTR_OP_PORT]);
+		val->port_vlan = nla_get_u32(attrs[SWITCH_ATTR_OP_PORT]);
 		if (val->port_vlan >= dev->ports)
 			goto done;
 		break;
@@ -549,7 +549,7 @@ swconfig_lookup_attr(struct switch_dev *dev, struct genl_info *info,
 	if (!alist)
 		goto done;
 
-	attr_id = nla_get_u32(info->attrs[SWITCH_ATTR_OP_ID]);
+	attr_id = nla_get_u32(attrs[SWITCH_ATTR_OP_ID]);
 	if (attr_id >= SWITCH_ATTR_DEFAULTS_OFFSET) {
 		attr_id -= SWITCH_ATTR_DEFAULTS_OFFSET;
 		if (attr_id >= n_def)
@@ -623,40 +623,33 @@ swconfig_parse_link(struct sk_buff *msg, struct nlattr *nla,
 }
 
 static int
-swconfig_set_attr(struct sk_buff *skb, struct genl_info *info)
+__swconfig_set_attr(struct switch_dev *dev, int cmd, struct nlattr **attrs,
+		struct sk_buff *skb)
 {
 	const struct switch_attr *attr;
-	struct switch_dev *dev;
 	struct switch_val val;
 	int err = -EINVAL;
 
-	if (!capable(CAP_NET_ADMIN))
-		return -EPERM;
-
-	dev = swconfig_get_dev(info);
-	if (!dev)
-		return -EINVAL;
-
 	memset(&val, 0, sizeof(val));
-	attr = swconfig_lookup_attr(dev, info, &val);
+	attr = swconfig_lookup_attr(dev, cmd, attrs, &val);
 	if (!attr || !attr->set)
-		goto error;
+		return -EINVAL;
 
 	val.attr = attr;
 	switch (attr->type) {
 	case SWITCH_TYPE_NOVAL:
 		break;
 	case SWITCH_TYPE_INT:
-		if (!info->attrs[SWITCH_ATTR_OP_VALUE_INT])
-			goto error;
+		if (!attrs[SWITCH_ATTR_OP_VALUE_INT])
+			return err;
 		val.value.i =
-			nla_get_u32(info->attrs[SWITCH_ATTR_OP_VALUE_INT]);
+			nla_get_u32(attrs[SWITCH_ATTR_OP_VALUE_INT]);
 		break;
 	case SWITCH_TYPE_STRING:
-		if (!info->attrs[SWITCH_ATTR_OP_VALUE_STR])
-			goto error;
+		if (!attrs[SWITCH_ATTR_OP_VALUE_STR])
+			return err;
 		val.value.s =
-			nla_data(info->attrs[SWITCH_ATTR_OP_VALUE_STR]);
+			nla_data(attrs[SWITCH_ATTR_OP_VALUE_STR]);
 		break;
 	case SWITCH_TYPE_PORTS:
 		val.value.ports = dev->portbuf;
@@ -664,12 +657,12 @@ swconfig_set_attr(struct sk_buff *skb, struct genl_info *info)
 			sizeof(struct switch_port) * dev->ports);
 
 		/* TODO: implement multipart? */
-		if (info->attrs[SWITCH_ATTR_OP_VALUE_PORTS]) {
+		if (attrs[SWITCH_ATTR_OP_VALUE_PORTS]) {
 			err = swconfig_parse_ports(skb,
-				info->attrs[SWITCH_ATTR_OP_VALUE_PORTS],
+				attrs[SWITCH_ATTR_OP_VALUE_PORTS],
 				&val, dev->ports);
 			if (err < 0)
-				goto error;
+				return err;
 		} else {
 			val.len = 0;
 			err = 0;
@@ -679,23 +672,92 @@ swconfig_set_attr(struct sk_buff *skb, struct genl_info *info)
 		val.value.link = &dev->linkbuf;
 		memset(&dev->linkbuf, 0, sizeof(struct switch_port_link));
 
-		if (info->attrs[SWITCH_ATTR_OP_VALUE_LINK]) {
+		if (attrs[SWITCH_ATTR_OP_VALUE_LINK]) {
 			err = swconfig_parse_link(skb,
-						  info->attrs[SWITCH_ATTR_OP_VALUE_LINK],
+						  attrs[SWITCH_ATTR_OP_VALUE_LINK],
 						  val.value.link);
 			if (err < 0)
-				goto error;
+				return err;
 		} else {
 			val.len = 0;
 			err = 0;
 		}
 		break;
 	default:
-		goto error;
+		return err;
 	}
 
-	err = attr->set(dev, attr, &val);
-error:
+	return attr->set(dev, attr, &val);
+}
+
+static int
+swconfig_set_attr(struct sk_buff *skb, struct genl_info *info)
+{
+	struct genlmsghdr *hdr = nlmsg_data(info->nlhdr);
+	struct switch_dev *dev;
+	int err;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	dev = swconfig_get_dev(info);
+	if (!dev)
+		return -EINVAL;
+
+	err = __swconfig_set_attr(dev, hdr->cmd, info->attrs, skb);
+	swconfig_put_dev(dev);
+	return err;
+}
+
+/*
+ * Apply a list of SET_GLOBAL/SET_PORT/SET_VLAN operations with a single
+ * device lookup and lock. Every entry of SWITCH_ATTR_OP_BATCH is a nest
+ * with the set command as its type and the usual operation attributes as
+ * its payload. Processing stops at the first failing entry.
+ */
+static int
+swconfig_set_batch(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *tb[SWITCH_ATTR_MAX + 1];
+	struct switch_dev *dev;
+	struct nlattr *nla;
+	int err = 0;
+	int rem;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (!info->attrs[SWITCH_ATTR_OP_BATCH])
+		return -EINVAL;
+
+	dev = swconfig_get_dev(info);
+	if (!dev)
+		return -EINVAL;
+
+	nla_for_each_nested(nla, info->attrs[SWITCH_ATTR_OP_BATCH], rem) {
+		int cmd = nla_type(nla);
+
+		switch (cmd) {
+		case SWITCH_CMD_SET_GLOBAL:
+		case SWITCH_CMD_SET_PORT:
+		case SWITCH_CMD_SET_VLAN:
+			break;
+		default:
+			err = -EINVAL;
+			goto out;
+		}
+
+		err = nla_parse_nested_deprecated(tb, SWITCH_ATTR_MAX, nla,
+						  switch_policy, NULL);
+		if (err)
+			goto out;
+
+		err = __swconfig_set_attr(dev, cmd, tb, skb);
+		if (err < 0)
+			goto out;
+	}
+
+out:
 	swconfig_put_dev(dev);
 	return err;
 }
@@ -836,7 +898,7 @@ swconfig_get_attr(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 
 	memset(&val, 0, sizeof(val));
-	attr = swconfig_lookup_attr(dev, info, &val);
+	attr = swconfig_lookup_attr(dev, cmd, info->attrs, &val);
 	if (!attr || !attr->get)
 		goto error;
 
@@ -1036,6 +1098,12 @@ static struct genl_ops swconfig_ops[] = {
 		.flags = GENL_ADMIN_PERM,
 		.doit = swconfig_set_attr,
 	},
+	{
+		.cmd = SWITCH_CMD_SET_BATCH,
+		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
+		.flags = GENL_ADMIN_PERM,
+		.doit = swconfig_set_batch,
+	},
 	{
 		.cmd = SWITCH_CMD_GET_SWITCH,
 		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
@@ -1053,7 +1121,7 @@ static struct genl_family switch_fam = {
 	.module = THIS_MODULE,
 	.ops = swconfig_ops,
 	.n_ops = ARRAY_SIZE(swconfig_ops),
-	.resv_start_op = SWITCH_CMD_SET_VLAN + 1,
+	.resv_start_op = SWITCH_CMD_SET_BATCH + 1,
 };
 
 #ifdef CONFIG_OF
@@ -54,6 +54,8 @@ enum {
 	SWITCH_ATTR_OP_DESCRIPTION,
 	/* port lists */
 	SWITCH_ATTR_PORT,
+	/* batched set operations */
+	SWITCH_ATTR_OP_BATCH,
 	SWITCH_ATTR_MAX
 };
 
@@ -78,7 +80,8 @@ enum {
 	SWITCH_CMD_SET_PORT,
 	SWITCH_CMD_LIST_VLAN,
 	SWITCH_CMD_GET_VLAN,
-	SWITCH_CMD_SET_VLAN
+	SWITCH_CMD_SET_VLAN,
+	SWITCH_CMD_SET_BATCH
 };
 
 /* data types */